@@ -0,0 +1,52 @@
+#include "bench.h"
+#include <syslog.h>
+#include <cstddef>
+
+// malloc, calloc and realloc of the whole process (libc and operator new
+// included) go through here and are counted, single threaded
+static uint64_t g_allocations = 0;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void __libc_free(void* pointer);
+
+void* malloc(size_t size) {
+    ++g_allocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    ++g_allocations;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    ++g_allocations;
+    return __libc_realloc(pointer, size);
+}
+
+void free(void* pointer) {
+    __libc_free(pointer);
+}
+}
+
+uint64_t bench_allocations() {
+    return g_allocations;
+}
+
+int main() {
+    // Benchmarked code logs state changes, only real problems are of interest
+    openlog(BENCH_LOG_IDENT, LOG_PERROR, LOG_USER);
+    setlogmask(LOG_UPTO(LOG_ERR));
+    
+    bool passed = run_hot_path_benches();
+    passed &= run_allocation_checks();
+    passed &= run_latency_benches();
+    passed &= run_readback_checks();
+    passed &= run_overlay_checks();
+    
+    closelog();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,70 @@
+#ifndef __LEDCTL_BENCH_H__
+#define __LEDCTL_BENCH_H__
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+#include "os.h"
+
+// Logged as, errors also go to stderr
+#define BENCH_LOG_IDENT "ugreen_leds_ethutild_bench"
+
+// Heap allocations (malloc, calloc, realloc) since the process started
+uint64_t bench_allocations();
+
+// Keep the compiler from optimising a result away
+template <typename T>
+inline void bench_keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct bench_result_t {
+    uint64_t ops;
+    double ns_per_op;
+    double allocs_per_op;
+    double calls_per_op;        // system calls through os.h
+};
+
+// Run fn in growing batches until a batch takes at least min_ms, after one
+// warm-up call, and print the cost of one call
+template <typename F>
+bench_result_t run_bench(const char* name, F fn, uint32_t min_ms = 200) {
+    fn();
+    
+    uint64_t ops = 1;
+    while (true) {
+        uint64_t allocations = bench_allocations();
+        uint64_t calls = os_get_call_total();
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < ops; ++i) {
+            fn();
+        }
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        allocations = bench_allocations() - allocations;
+        calls = os_get_call_total() - calls;
+        
+        if (elapsed >= std::chrono::milliseconds(min_ms) || ops >= (1ull << 40)) {
+            bench_result_t result = {
+                ops,
+                std::chrono::duration<double, std::nano>(elapsed).count() / ops,
+                (double)allocations / ops,
+                (double)calls / ops
+            };
+            printf("%-32s %12.1f ns/op %8.2f allocs/op %6.2f syscalls/op %12llu ops\n", name, result.ns_per_op,
+                   result.allocs_per_op, result.calls_per_op, (unsigned long long)ops);
+            fflush(stdout);
+            return result;
+        }
+        ops *= 2;
+    }
+}
+
+// Suites, each returns false if a check failed
+bool run_hot_path_benches();
+bool run_allocation_checks();
+bool run_latency_benches();
+bool run_readback_checks();
+bool run_overlay_checks();
+
+#endif
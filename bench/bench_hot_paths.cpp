@@ -0,0 +1,146 @@
+#include "bench.h"
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bandwidth_monitor.h"
+#include "config_parser.h"
+#include "led_controller.h"
+#include "led_state_manager.h"
+#include "level_table.h"
+
+// Interface whose counters are read, lo exists everywhere
+static std::string bench_interface() {
+    const char* interface = getenv("BENCH_INTERFACE");
+    return interface ? interface : "lo";
+}
+
+static bool bench_counters(const std::string& interface) {
+    bool passed = true;
+    
+    struct backend_t {
+        const char* title;
+        const char* name;
+        bool extended;
+    };
+    const backend_t backends[] = {
+        {"counters/sysfs", "auto", false},
+        {"counters/procfs", "procfs", true},
+        {"counters/netlink", "netlink", true}
+    };
+    
+    for (const backend_t& backend : backends) {
+        bandwidth_monitor_t monitor(interface, 2000);
+        monitor.set_counter_backend(backend.name);
+        
+        // Initialized like the service's, so the link identity is not re-read every time
+        network_stats_t stats = monitor.read_network_stats();
+        if (!monitor.initialize() || stats.rx_bytes == UINT64_MAX || stats.has_extended != backend.extended) {
+            printf("%-32s cannot read the counters of %s\n", backend.title, interface.c_str());
+            passed = false;
+            continue;
+        }
+        
+        run_bench(backend.title, [&]() {
+            bench_keep(monitor.read_network_stats());
+        });
+    }
+    
+    return passed;
+}
+
+static bool bench_net_dev_parse() {
+    // A NAS with a few bridges and containers, the monitored interface last
+    std::string text =
+        "Inter-|   Receive                                                |  Transmit\n"
+        " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n";
+    for (const char* name : {"lo", "docker0", "br-lan", "veth1a2b3c", "veth4d5e6f", "wg0", "eth1"}) {
+        text += std::string(name) + ": 1234567890 9876543 0 12 0 0 0 345 987654321 7654321 0 0 0 0 0 0\n";
+    }
+    text += "  eth0: 98765432109876 87654321098 3 1234 5 0 0 67890 12345678901234 9876543210 0 7 0 0 0 0\n";
+    
+    network_stats_t stats = {};
+    if (!bandwidth_monitor_t::parse_net_dev(text.c_str(), "eth0", stats) || stats.tx_dropped != 7) {
+        printf("%-32s parse failed\n", "parse/net_dev");
+        return false;
+    }
+    
+    run_bench("parse/net_dev", [&]() {
+        bool parsed = bandwidth_monitor_t::parse_net_dev(text.c_str(), "eth0", stats);
+        bench_keep(parsed);
+        bench_keep(stats);
+    });
+    return true;
+}
+
+static bool bench_framing() {
+    // A set_rgb command frame as built by _change_status
+    run_bench("framing/append_checksum", []() {
+        uint8_t data[LEDCTL_FRAME_SIZE] { 0x00, 0xa0, 0x01, 0x00, 0x00, 0x02, 0x12, 0x34, 0x56, 0x00 };
+        led_controller_t::append_checksum(data, LEDCTL_FRAME_SIZE - 2);
+        bench_keep(data);
+    });
+    
+    uint8_t status[11] { 0x01, 0xff, 0x00, 0xff, 0x00, 0x00, 0x00, 0x00, 0x00 };
+    led_controller_t::append_checksum(status, sizeof(status) - 2);
+    if (!led_controller_t::verify_checksum(status, sizeof(status))) {
+        printf("%-32s checksum mismatch\n", "framing/verify_checksum");
+        return false;
+    }
+    
+    run_bench("framing/verify_checksum", [&]() {
+        bench_keep(led_controller_t::verify_checksum(status, sizeof(status)));
+    });
+    return true;
+}
+
+static bool bench_level_lookup() {
+    level_table_t levels;
+    levels.set_capacity(2000.0);
+    
+    // Spread over all levels, so the lookup cannot be predicted
+    std::vector<double> values;
+    uint32_t seed = 12345;
+    for (int i = 0; i < 1024; ++i) {
+        seed = seed * 1103515245 + 12345;
+        values.push_back((seed >> 8) % 2000);
+    }
+    
+    size_t index = 0;
+    run_bench("levels/find", [&]() {
+        bench_keep(levels.find(values[index++ & 1023]));
+    });
+    return true;
+}
+
+static bool bench_apply_state() {
+    led_controller_t controller;
+    controller.start_mock();
+    ledctl_config_t config;
+    led_state_manager_t state_manager(controller, config);
+    state_manager.set_capacity_mbps(2000, 1000);
+    
+    // Every call changes the level, the worst case of a busy link
+    led_state_t count = (led_state_t)state_manager.get_levels().size();
+    led_state_t state = 0;
+    uint64_t writes = controller.get_write_count();
+    bench_result_t result = run_bench("leds/apply_state (mock bus)", [&]() {
+        state = (led_state_t)((state + 1) % count);
+        state_manager.set_state(state);
+    });
+    
+    printf("%-32s %12.1f writes/op\n", "", (double)(controller.get_write_count() - writes) / (result.ops + 1));
+    return true;
+}
+
+bool run_hot_path_benches() {
+    printf("# hot paths (interface %s)\n", bench_interface().c_str());
+    
+    bool passed = true;
+    passed &= bench_counters(bench_interface());
+    passed &= bench_net_dev_parse();
+    passed &= bench_framing();
+    passed &= bench_level_lookup();
+    passed &= bench_apply_state();
+    return passed;
+}
@@ -0,0 +1,136 @@
+#include "bench.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "adaptive_scheduler.h"
+#include "bandwidth_monitor.h"
+#include "config_parser.h"
+#include "led_controller.h"
+#include "led_state_manager.h"
+#include "metric_scheduler.h"
+#include "metric_sources.h"
+#include "monitor_loop.h"
+
+#define LATENCY_TRIALS 1000
+#define LATENCY_CAPACITY_MBPS 2000
+
+// Long enough for the scheduler to back off to its slowest interval
+#define LATENCY_IDLE_S 60
+
+// A trial that has not lit the top level by then has failed
+#define LATENCY_TIMEOUT_S 60
+
+// Counters of a full duplex link that is idle until the step and saturated
+// in both directions from then on, read at the simulated time
+class step_source_t : public counter_source_t {
+private:
+    metric_time_t _now;
+    metric_time_t _step_at;
+    double _bytes_per_s;
+
+public:
+    step_source_t(metric_time_t step_at, uint32_t capacity_mbps)
+        : _now(), _step_at(step_at), _bytes_per_s(capacity_mbps / 2 * 1000000.0 / 8.0) {}
+    
+    void set_time(metric_time_t now) { _now = now; }
+    
+    bool read(network_stats_t& stats) override {
+        double busy_s = std::max(0.0, std::chrono::duration<double>(_now - _step_at).count());
+        stats.rx_bytes = stats.tx_bytes = (uint64_t)(busy_s * _bytes_per_s);
+        stats.ifindex = 1;
+        stats.carrier_changes = 0;
+        stats.timestamp = _now;
+        return true;
+    }
+};
+
+struct latency_sample_t {
+    double total_ms;        // traffic step to the last byte of the top level's frame
+    double frame_ms;        // tick that decided on the top level to that last byte
+};
+
+// One step from idle to saturated, phase_s after the scheduler settled on its
+// slowest interval. Runs the service's loop body on a simulated clock: every
+// wait is the scheduler's interval, started once the tick's LED writes (with
+// their pauses and bus time on the mock bus) are done.
+static bool run_latency_trial(const ledctl_config_t& config, double phase_s, latency_sample_t& sample) {
+    metric_time_t start = metric_time_t() + std::chrono::hours(1);
+    metric_time_t step_at = start + std::chrono::seconds(LATENCY_IDLE_S) +
+                            std::chrono::duration_cast<metric_time_t::duration>(std::chrono::duration<double>(phase_s));
+    
+    led_controller_t controller;
+    controller.start_mock();
+    controller.set_mock_time(start);
+    led_state_manager_t state_manager(controller, config);
+    state_manager.set_capacity_mbps(LATENCY_CAPACITY_MBPS, LATENCY_CAPACITY_MBPS / 2);
+    state_manager.set_state(0);
+    led_state_t top = (led_state_t)(state_manager.get_levels().size() - 1);
+    
+    step_source_t source(step_at, LATENCY_CAPACITY_MBPS);
+    source.set_time(start);
+    bandwidth_monitor_t monitor(config.interface, LATENCY_CAPACITY_MBPS);
+    monitor.set_counter_source(&source);
+    monitor.initialize_from(monitor.read_network_stats());
+    
+    metric_scheduler_t metrics;
+    nic_bytes_source_t network_source(monitor);
+    metrics.add_source(&network_source, 0);
+    adaptive_scheduler_t scheduler(config);
+    monitor_loop_t loop(metrics, network_source, nullptr, state_manager, scheduler, nullptr, nullptr);
+    
+    auto interval = [&scheduler]() { return std::chrono::milliseconds(scheduler.get_interval_ms()); };
+    metric_time_t now = std::max(start, controller.get_last_write_end()) + interval();
+    while (now - step_at < std::chrono::seconds(LATENCY_TIMEOUT_S)) {
+        source.set_time(now);
+        controller.set_mock_time(now);
+        if (!loop.tick(now)) {
+            return false;
+        }
+        
+        if (now >= step_at && state_manager.get_current_state() == top) {
+            metric_time_t done = controller.get_last_write_end();
+            sample.total_ms = std::chrono::duration<double, std::milli>(done - step_at).count();
+            sample.frame_ms = std::chrono::duration<double, std::milli>(done - now).count();
+            return true;
+        }
+        
+        now = std::max(now, controller.get_last_write_end()) + interval();
+    }
+    return false;
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    size_t index = (size_t)std::ceil(p * sorted.size());
+    return sorted[index ? index - 1 : 0];
+}
+
+bool run_latency_benches() {
+    ledctl_config_t config;
+    printf("# reaction latency, idle to saturated (interval %u-%u ms, %d trials, simulated clock)\n",
+           config.interval_ms, config.max_interval_ms, LATENCY_TRIALS);
+    
+    // Same phases on every run, so results can be compared
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> phase(0.0, config.max_interval_ms / 1000.0);
+    
+    std::vector<double> totals, frames;
+    for (int i = 0; i < LATENCY_TRIALS; ++i) {
+        latency_sample_t sample;
+        if (!run_latency_trial(config, phase(random), sample)) {
+            printf("%-32s the top level was not reached within %d s  FAILED\n", "latency/step", LATENCY_TIMEOUT_S);
+            return false;
+        }
+        totals.push_back(sample.total_ms);
+        frames.push_back(sample.frame_ms);
+    }
+    
+    std::sort(totals.begin(), totals.end());
+    std::sort(frames.begin(), frames.end());
+    printf("%-32s %10.1f ms p50 %10.1f ms p99 %10.1f ms max\n", "latency/step to last LED byte",
+           percentile(totals, 0.5), percentile(totals, 0.99), totals.back());
+    printf("%-32s %10.1f ms p50 %10.1f ms p99 %10.1f ms max\n", "latency/frame on the bus",
+           percentile(frames, 0.5), percentile(frames, 0.99), frames.back());
+    return true;
+}
@@ -0,0 +1,61 @@
+#include "bench.h"
+#include <chrono>
+#include <thread>
+
+#include "config_parser.h"
+#include "led_controller.h"
+#include "led_state_manager.h"
+
+#define OVERLAY_CAPACITY_MBPS 2000
+#define OVERLAY_NOTIFY_S 1
+
+static bool is_off(led_controller_t& controller, led_controller_t::led_type_t id) {
+    return controller.get_status(id).op_mode == led_controller_t::op_mode_t::off;
+}
+
+// Overlays on the mock MCU: an LED that only a notification drove must go
+// dark again once the notification expired, and maintenance mode must
+// darken every LED but power whichever layer claims it
+bool run_overlay_checks() {
+    printf("# LED overlays\n");
+    
+    ledctl_config_t config;
+    led_controller_t controller;
+    controller.start_mock();
+    led_state_manager_t state_manager(controller, config);
+    state_manager.set_capacity_mbps(OVERLAY_CAPACITY_MBPS, OVERLAY_CAPACITY_MBPS / 2);
+    state_manager.set_state((led_state_t)(state_manager.get_levels().size() - 1));
+    
+    // No layer below the notification manages disk5 with the default config
+    auto id = led_controller_t::led_type_t::disk5;
+    state_manager.notify(id, make_led_target(true, COLOR_WHITE, 255, led_effect_t::blink, 500, 500), OVERLAY_NOTIFY_S);
+    bool lit = !is_off(controller, id);
+    
+    std::this_thread::sleep_for(std::chrono::milliseconds(OVERLAY_NOTIFY_S * 1000 + 100));
+    uint64_t writes = controller.get_write_count();
+    state_manager.update_overlays();
+    bool expired_ok = lit && is_off(controller, id) && controller.get_write_count() - writes == 1;
+    
+    // Left alone from then on
+    writes = controller.get_write_count();
+    state_manager.update_overlays();
+    expired_ok &= controller.get_write_count() == writes;
+    printf("%-32s %10s %6s  %s\n", "overlays/notification expired", lit ? "lit" : "not lit",
+           is_off(controller, id) ? "off" : "on", expired_ok ? "ok" : "FAILED");
+    
+    // Maintenance darkens every LED but power, also one claimed after it started
+    state_manager.set_maintenance(true);
+    state_manager.notify(id, make_led_target(true, COLOR_WHITE, 255), 0);
+    size_t lit_leds = 0;
+    for (size_t i = 0; i < LEDCTL_LED_COUNT; ++i) {
+        lit_leds += !is_off(controller, (led_controller_t::led_type_t)i);
+    }
+    bool maintenance_ok = lit_leds == 1 &&
+                          controller.get_status(LEDCTL_LED_POWER).op_mode == led_controller_t::op_mode_t::breath;
+    
+    // and gives the LEDs back to the layers below when it ends
+    state_manager.set_maintenance(false);
+    maintenance_ok &= !is_off(controller, id) && !is_off(controller, LEDCTL_LED_NETDEV);
+    printf("%-32s %10zu %6s  %s\n", "overlays/maintenance", lit_leds, "lit", maintenance_ok ? "ok" : "FAILED");
+    return expired_ok && maintenance_ok;
+}
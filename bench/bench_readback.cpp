@@ -0,0 +1,75 @@
+#include "bench.h"
+#include <chrono>
+
+#include "config_parser.h"
+#include "led_controller.h"
+#include "led_state_manager.h"
+
+#define READBACK_CAPACITY_MBPS 2000
+#define READBACK_STEP_MS 100
+
+// Long enough for several rounds over every lit LED
+#define READBACK_QUIET_S 120
+#define READBACK_REPAIR_TIMEOUT_S 120
+
+static bool same_status(const led_controller_t::led_data_t& a, const led_controller_t::led_data_t& b) {
+    return a.op_mode == b.op_mode && a.brightness == b.brightness && a.color_r == b.color_r &&
+           a.color_g == b.color_g && a.color_b == b.color_b;
+}
+
+// The top level on the mock MCU, read back on a simulated clock: first
+// untouched, where nothing may be written and the reads must stay within the
+// budget, then after another writer recolored one LED and switched another
+// off, where exactly those two fields must be written back
+bool run_readback_checks() {
+    ledctl_config_t config;
+    printf("# LED readback (%u bytes/s, simulated clock)\n", config.readback_bytes_per_s);
+    
+    led_controller_t controller;
+    controller.start_mock();
+    led_state_manager_t state_manager(controller, config);
+    state_manager.set_capacity_mbps(READBACK_CAPACITY_MBPS, READBACK_CAPACITY_MBPS / 2);
+    state_manager.set_state((led_state_t)(state_manager.get_levels().size() - 1));
+    
+    std::array<led_controller_t::led_data_t, LEDCTL_LED_COUNT> written;
+    for (size_t i = 0; i < written.size(); ++i) {
+        written[i] = controller.get_status((led_controller_t::led_type_t)i);
+    }
+    
+    metric_time_t now = metric_time_t() + std::chrono::hours(1);
+    auto run = [&](int seconds, uint64_t repairs) {
+        metric_time_t end = now + std::chrono::seconds(seconds);
+        while (now < end && state_manager.get_repair_count() < repairs) {
+            controller.set_mock_time(now);
+            state_manager.reconcile(now);
+            now += std::chrono::milliseconds(READBACK_STEP_MS);
+        }
+    };
+    
+    uint64_t reads = controller.get_read_count();
+    uint64_t writes = controller.get_write_count();
+    run(READBACK_QUIET_S, 1);
+    double bytes_per_s = (double)(controller.get_read_count() - reads) * LEDCTL_STATUS_BUS_BYTES / READBACK_QUIET_S;
+    bool quiet_ok = controller.get_write_count() == writes && state_manager.get_repair_count() == 0 &&
+                    controller.get_read_count() > reads && bytes_per_s <= config.readback_bytes_per_s;
+    printf("%-32s %10.2f bytes/s read %6llu writes  %s\n", "readback/untouched", bytes_per_s,
+           (unsigned long long)(controller.get_write_count() - writes), quiet_ok ? "ok" : "FAILED");
+    
+    // Another writer that did not take the bus lock
+    controller.set_rgb(LEDCTL_LED_NETDEV, 1, 2, 3);
+    controller.turn_off_led(LEDCTL_LED_POWER);
+    
+    metric_time_t changed = now;
+    writes = controller.get_write_count();
+    run(READBACK_REPAIR_TIMEOUT_S, 2);
+    double repair_s = std::chrono::duration<double>(now - changed).count();
+    
+    bool repaired = true;
+    for (size_t i = 0; i < written.size(); ++i) {
+        repaired &= same_status(controller.get_status((led_controller_t::led_type_t)i), written[i]);
+    }
+    bool repair_ok = repaired && controller.get_write_count() - writes == 2;
+    printf("%-32s %10.1f s to repair %6llu writes  %s\n", "readback/recolored and off", repair_s,
+           (unsigned long long)(controller.get_write_count() - writes), repair_ok ? "ok" : "FAILED");
+    return quiet_ok && repair_ok;
+}
@@ -0,0 +1,241 @@
+#include "bench.h"
+#include <stdlib.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <algorithm>
+
+#include "adaptive_scheduler.h"
+#include "bandwidth_monitor.h"
+#include "config_parser.h"
+#include "counter_generator.h"
+#include "disk_monitor.h"
+#include "history_archive.h"
+#include "led_controller.h"
+#include "led_state_manager.h"
+#include "metric_scheduler.h"
+#include "metric_sources.h"
+#include "monitor_loop.h"
+#include "os.h"
+#include "sys_root.h"
+#include "traffic_totals.h"
+
+// Every level once per second, so warm-up and measurement both see all transitions
+#define STEADY_PROFILE "0:0:0.25,300:100:0.25,700:300:0.25,950:900:0.25"
+#define STEADY_WARMUP_MS 1500
+#define STEADY_MEASURE_MS 2000
+
+// Above the 10 ms the bandwidth monitor needs between two samples
+#define STEADY_TICK_MS 12
+
+// System calls of an iteration that changes nothing: two preads for the
+// counters (two sysfs files, or /proc/net/dev and the ifindex), one more for
+// /proc/diskstats when disks are sampled, and the poll of the wait. No log
+// message at the level the service logs at by default (info).
+#define STEADY_LOG_LEVEL LOG_INFO
+#define STEADY_COUNTER_CALLS 2
+#define STEADY_DISK_CALLS 1
+#define STEADY_WAIT_CALLS 1
+
+struct steady_pass_t {
+    const char* name;
+    const char* counters;
+    bool per_direction;
+    bool peak;
+    bool alerts;
+    bool disks;
+};
+
+// A disk in bay ata1, the way sysfs links it
+static bool create_fake_disk(const std::string& root) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    fs::create_directories(root + "/sys/devices/pci0000:00/0000:00:17.0/ata1/host0/block/sda", error);
+    fs::create_directories(root + "/sys/block", error);
+    fs::create_symlink("../devices/pci0000:00/0000:00:17.0/ata1/host0/block/sda", root + "/sys/block/sda", error);
+    
+    std::ofstream diskstats(root + "/proc/diskstats");
+    diskstats << "   8       0 sda 1000 0 200000 500 2000 0 400000 600 0 1000 1100\n";
+    return !error && diskstats.good();
+}
+
+// Runs the service's loop body against a fake tree and the mock bus and
+// counts the heap allocations after warm-up, which must be none outside of
+// the log messages
+static bool check_steady_state(const std::string& root, const steady_pass_t& pass) {
+    ledctl_config_t config;
+    config.interface = "bench0";
+    config.interval_ms = STEADY_TICK_MS;
+    config.max_interval_ms = STEADY_TICK_MS;
+    config.capacity_mbps = 0;
+    config.counters = pass.counters;
+    config.display_mode = pass.per_direction ? "per_direction" : "combined";
+    config.peak_enabled = pass.peak;
+    config.peak_hold_ms = 100;              // short enough to fall back within a profile step
+    config.peak_decay_percentage = 1000;
+    config.alert_drop_rate = pass.alerts ? 100 : 0;
+    config.alert_error_rate = pass.alerts ? 100 : 0;
+    
+    std::vector<traffic_step_t> profile;
+    counter_generator_t generator;
+    if (!counter_generator_t::parse_profile(STEADY_PROFILE, profile) ||
+        !generator.create(root, config.interface, 1000, profile) || !create_fake_disk(root)) {
+        printf("%-36s cannot create the fake tree below %s\n", pass.name, root.c_str());
+        return false;
+    }
+    
+    led_controller_t controller;
+    if (controller.start(config.led_bus) != 0 || !controller.is_mock()) {
+        printf("%-36s the fake adapter did not select the mock bus\n", pass.name);
+        return false;
+    }
+    led_state_manager_t state_manager(controller, config);
+    state_manager.set_state(0);
+    
+    bandwidth_monitor_t monitor(config.interface, config.capacity_mbps);
+    monitor.set_counter_backend(config.counters);
+    if (pass.alerts) {
+        monitor.enable_extended_counters();
+    }
+    if (!monitor.initialize()) {
+        printf("%-36s cannot read the fake counters\n", pass.name);
+        return false;
+    }
+    state_manager.set_capacity_mbps(monitor.get_capacity_mbps(), monitor.get_direction_capacity_mbps());
+    
+    disk_monitor_t disk_monitor(config.disk_ports);
+    disk_monitor.initialize();
+    
+    metric_scheduler_t metrics;
+    nic_bytes_source_t network_source(monitor);
+    disk_source_t disk_source(disk_monitor, config.disk_capacity_mbs);
+    metrics.add_source(&network_source, 0);
+    if (pass.disks) {
+        metrics.add_source(&disk_source, 0);
+    }
+    
+    adaptive_scheduler_t scheduler(config);
+    history_archive_t history;
+    traffic_totals_t totals;
+    history.open(root + "/history.rrd", 0);
+    totals.open(root + "/totals.bench0", config.interface, 0);   // written on every sample
+    
+    monitor_loop_t loop(metrics, network_source, pass.disks ? &disk_source : nullptr, state_manager, scheduler,
+                        &history, &totals);
+    
+    uint64_t allocations = 0;
+    size_t ticks = 0;
+    uint64_t writes = 0;
+    uint64_t logs = 0;
+    size_t idle_ticks = 0;
+    uint64_t max_tick_calls = 0;    // of the iterations that neither lit nor read back an LED nor persisted anything
+    uint64_t max_wait_calls = 0;
+    bool passed = true;
+    
+    // Writes of the totals file and syncs of the history archive
+    auto persisted = [](const os_call_counts_t& calls) {
+        return calls.get(os_call_t::write) + calls.get(os_call_t::fsync) + calls.get(os_call_t::msync);
+    };
+    
+    // Logging as the service does outside of console mode
+    openlog(BENCH_LOG_IDENT, LOG_PID, LOG_USER);
+    int log_mask = setlogmask(LOG_UPTO(STEADY_LOG_LEVEL));
+    auto start = std::chrono::steady_clock::now();
+    auto measure_from = start + std::chrono::milliseconds(STEADY_WARMUP_MS);
+    auto end = measure_from + std::chrono::milliseconds(STEADY_MEASURE_MS);
+    auto last = start;
+    
+    while (passed) {
+        uint64_t wait_calls = os_get_call_total();
+        scheduler.wait();
+        wait_calls = os_get_call_total() - wait_calls;
+        
+        auto now = std::chrono::steady_clock::now();
+        if (now >= end) {
+            break;
+        }
+        
+        // The generator stands in for the kernel, its allocations and system calls do not count
+        generator.advance(std::chrono::duration<double>(now - last).count());
+        last = now;
+        
+        os_call_counts_t calls_before, calls_after;
+        uint64_t writes_before = controller.get_write_count();
+        uint64_t reads_before = controller.get_read_count();
+        os_get_call_counts(calls_before);
+        uint64_t before = bench_allocations();
+        passed = loop.tick(now);
+        uint64_t after = bench_allocations();
+        os_get_call_counts(calls_after);
+        
+        if (now >= measure_from) {
+            uint64_t tick_writes = controller.get_write_count() - writes_before;
+            writes += tick_writes;
+            ++ticks;
+            
+            // glibc before 2.37 formats every log message through open_memstream
+            uint64_t tick_logs = calls_after.get(os_call_t::syslog) - calls_before.get(os_call_t::syslog);
+            logs += tick_logs;
+            if (tick_logs == 0) {
+                allocations += after - before;
+            }
+            
+            bool read_back = controller.get_read_count() != reads_before;
+            if (tick_writes == 0 && !read_back && persisted(calls_after) == persisted(calls_before)) {
+                max_tick_calls = std::max(max_tick_calls, calls_after.total() - calls_before.total());
+                max_wait_calls = std::max(max_wait_calls, wait_calls);
+                ++idle_ticks;
+            }
+        }
+    }
+    setlogmask(log_mask);
+    openlog(BENCH_LOG_IDENT, LOG_PERROR, LOG_USER);
+    
+    if (!passed) {
+        printf("%-36s the loop gave up\n", pass.name);
+        return false;
+    }
+    
+    // Without LED writes the level changes were not exercised, without idle
+    // ticks the budget was not
+    uint64_t tick_budget = STEADY_COUNTER_CALLS + (pass.disks ? STEADY_DISK_CALLS : 0);
+    bool ok = allocations == 0 && writes > 0 && idle_ticks > 0 &&
+              max_tick_calls <= tick_budget && max_wait_calls <= STEADY_WAIT_CALLS;
+    printf("%-36s %6zu ticks %5llu LED writes %4llu logs %4llu allocs  idle: %llu/%llu calls + %llu/%d wait  %s\n",
+           pass.name, ticks, (unsigned long long)writes, (unsigned long long)logs, (unsigned long long)allocations,
+           (unsigned long long)max_tick_calls, (unsigned long long)tick_budget,
+           (unsigned long long)max_wait_calls, STEADY_WAIT_CALLS, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+bool run_allocation_checks() {
+    printf("# steady state allocations and system calls (after %d ms of warm-up)\n", STEADY_WARMUP_MS);
+    
+    char root_template[] = "/tmp/ugreen_leds_bench.XXXXXX";
+    if (!mkdtemp(root_template)) {
+        printf("cannot create a temporary directory\n");
+        return false;
+    }
+    std::string root = root_template;
+    
+    const steady_pass_t passes[] = {
+        {"loop/sysfs, combined", "auto", false, false, false, false},
+        {"loop/procfs, per direction, alerts", "procfs", true, false, true, true},
+        {"loop/sysfs, peak hold, disks", "auto", false, true, false, true}
+    };
+    
+    // A fresh tree for every pass
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(passes) / sizeof(passes[0]); ++i) {
+        std::string pass_root = root + "/" + std::to_string(i);
+        set_sys_root(pass_root);
+        passed &= check_steady_state(pass_root, passes[i]);
+    }
+    
+    set_sys_root("");
+    std::error_code error;
+    std::filesystem::remove_all(root, error);
+    return passed;
+}
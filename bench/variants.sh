@@ -0,0 +1,60 @@
+#!/bin/sh
+# Runs builds of the service end to end without hardware or root and reports,
+# per build: the binary size, the resident set of the running service and
+# its CPU cost per sample in the replay benchmark. Every build gets a fake
+# tree with generated traffic (--root, --generate), runs on it as the
+# service for RUN_SECONDS while recording its counters (--record), then
+# replays that recording (--replay). Also the training run of make pgo-gen.
+#
+#   sh bench/variants.sh NAME=BINARY...
+
+set -e
+
+RUN_SECONDS=${RUN_SECONDS:-5}
+
+# Every level for a second, sampled every 100 ms
+PROFILE=0:0:1,200:100:1,600:300:1,900:800:1
+
+printf "%-10s %12s %10s %14s %10s\n" variant "size (B)" "RSS (KiB)" "replay ns/op" samples
+
+for variant in "$@"; do
+    name=${variant%%=*}
+    binary=$(realpath "${variant#*=}")
+    dir=$(mktemp -d)
+
+    # The service reads its configuration from the working directory first
+    cat > "$dir/ugreen_leds_ethutild.conf" <<EOF
+[network]
+interface = bench0
+capacity_mbps = 2000
+
+[polling]
+interval_ms = 100
+max_interval_ms = 100
+link_events = false
+
+[logging]
+level = error
+EOF
+
+    cd "$dir"
+    "$binary" --root "$dir/root" --generate=$PROFILE > /dev/null &
+    generator=$!
+    sleep 0.5
+    "$binary" --root "$dir/root" --record "$dir/trace" 2> /dev/null &
+    service=$!
+    sleep "$RUN_SECONDS"
+
+    rss=$(awk '/^VmRSS:/ { print $2 }' /proc/$service/status)
+    kill -TERM $service $generator
+    wait $service $generator || true
+
+    # "# 1.234 ms, 123456 samples/s, 8100 ns/sample"
+    replay=$("$binary" --replay "$dir/trace")
+    ns=$(echo "$replay" | awk '/ns\/sample/ { print $(NF - 1) }')
+    samples=$(echo "$replay" | awk '/samples \(/ { print $2 }')
+    cd - > /dev/null
+    rm -rf "$dir"
+
+    printf "%-10s %12s %10s %14s %10s\n" "$name" "$(stat -c %s "$binary")" "$rss" "$ns" "$samples"
+done
@@ -0,0 +1,97 @@
+#include "adaptive_scheduler.h"
+#include "os.h"
+#include <syslog.h>
+#include <cerrno>
+#include <cmath>
+
+adaptive_scheduler_t::adaptive_scheduler_t(const ledctl_config_t& config, link_watcher_t* link_watcher)
+    : _min_interval_ms(config.interval_ms), _max_interval_ms(config.max_interval_ms),
+      _current_interval_ms(config.interval_ms), _idle_threshold(config.low_threshold),
+      _trigger_percentage(config.trigger_percentage), _last_usage(0.0), _has_last_usage(false),
+      _link_watcher(link_watcher), _wakeups(0), _wakeups_per_minute(0.0),
+      _window_start(std::chrono::steady_clock::now()) {
+}
+
+void adaptive_scheduler_t::update(double usage_percentage) {
+    double delta = _has_last_usage ? std::fabs(usage_percentage - _last_usage) : 0.0;
+    _last_usage = usage_percentage;
+    _has_last_usage = true;
+
+    // A trigger of 0 would match every sample and never let the interval back off
+    bool jumped = _trigger_percentage > 0 && delta >= _trigger_percentage;
+    if (usage_percentage >= _idle_threshold || jumped) {
+        if (_current_interval_ms != _min_interval_ms) {
+            os_syslog(LOG_DEBUG, "Activity detected (%.1f%%, delta %.1f%%), sampling every %u ms",
+                      usage_percentage, delta, _min_interval_ms);
+        }
+        _current_interval_ms = _min_interval_ms;
+        return;
+    }
+
+    // Idle: back off exponentially
+    uint32_t next = _current_interval_ms * 2;
+    if (next > _max_interval_ms || next < _current_interval_ms) {
+        next = _max_interval_ms;
+    }
+    if (next != _current_interval_ms) {
+        os_syslog(LOG_DEBUG, "Link idle (%.1f%%), sampling every %u ms", usage_percentage, next);
+    }
+    _current_interval_ms = next;
+}
+
+void adaptive_scheduler_t::reset() {
+    _current_interval_ms = _min_interval_ms;
+    _has_last_usage = false;
+}
+
+adaptive_scheduler_t::wake_reason_t adaptive_scheduler_t::wait() {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(_current_interval_ms);
+    int fd = _link_watcher ? _link_watcher->get_fd() : -1;
+
+    while (true) {
+        // Rounded up, so a plain timer wait is a single poll
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0) {
+            break;
+        }
+
+        pollfd pfd = { fd, POLLIN, 0 };
+        int rc = os_poll(&pfd, fd >= 0 ? 1 : 0, (int)remaining);
+        if (rc < 0) {
+            if (errno == EINTR) {
+                count_wakeup();
+                return wake_reason_t::signal;
+            }
+            break;
+        }
+        if (rc == 0) {
+            // Timed out, the deadline has passed
+            break;
+        }
+
+        if (_link_watcher->process_events()) {
+            os_syslog(LOG_INFO, "Link event received, resuming fast sampling");
+            reset();
+            count_wakeup();
+            return wake_reason_t::link_event;
+        }
+    }
+
+    count_wakeup();
+    return wake_reason_t::timer;
+}
+
+void adaptive_scheduler_t::count_wakeup() {
+    _wakeups++;
+
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - _window_start).count();
+    if (elapsed >= 60000) {
+        _wakeups_per_minute = _wakeups * 60000.0 / elapsed;
+        os_syslog(LOG_DEBUG, "Scheduler: %.1f wakeups/min (current interval %u ms)",
+                  _wakeups_per_minute, _current_interval_ms);
+        _wakeups = 0;
+        _window_start = now;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef __LEDCTL_ADAPTIVE_SCHEDULER_H__
+#define __LEDCTL_ADAPTIVE_SCHEDULER_H__
+
+#include <chrono>
+#include <cstdint>
+
+#include "config_parser.h"
+#include "link_watcher.h"
+
+// Decides how long to sleep between samples: the interval doubles while the
+// link stays idle (up to max_interval_ms) and snaps back to interval_ms as soon
+// as the usage climbs, jumps by trigger_percentage or the link changes state.
+class adaptive_scheduler_t {
+public:
+    enum class wake_reason_t {
+        timer, link_event, signal
+    };
+
+private:
+    uint32_t _min_interval_ms;
+    uint32_t _max_interval_ms;
+    uint32_t _current_interval_ms;
+    double _idle_threshold;
+    double _trigger_percentage;
+    double _last_usage;
+    bool _has_last_usage;
+    link_watcher_t* _link_watcher;
+
+    // Wakeup accounting
+    uint32_t _wakeups;
+    double _wakeups_per_minute;
+    std::chrono::steady_clock::time_point _window_start;
+
+    void count_wakeup();
+
+public:
+    adaptive_scheduler_t(const ledctl_config_t& config, link_watcher_t* link_watcher = nullptr);
+
+    // Feed the latest usage so the next interval can be chosen
+    void update(double usage_percentage);
+
+    // Go back to the fastest interval (e.g. after a link event or a failed sample)
+    void reset();
+
+    // Sleep until the next sample is due or a link event arrives
+    wake_reason_t wait();
+
+    uint32_t get_interval_ms() const { return _current_interval_ms; }
+    double get_wakeups_per_minute() const { return _wakeups_per_minute; }
+};
+
+#endif
@@ -1,72 +1,173 @@
 #include "bandwidth_monitor.h"
-#include <fstream>
-#include <sstream>
-#include <filesystem>
+#include "counter_trace.h"
+#include "sys_root.h"
+#include "os.h"
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+#include <sys/socket.h>
+#include <net/if.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <charconv>
 
 bandwidth_monitor_t::bandwidth_monitor_t(const std::string& interface, uint32_t capacity_mbps)
-    : _interface(interface), _capacity_mbps(capacity_mbps), _initialized(false) {
+    : _interface(interface), _capacity_mbps(capacity_mbps), _direction_capacity_mbps(capacity_mbps / 2),
+      _auto_capacity(capacity_mbps == 0), _initialized(false), _extended_counters(false),
+      _info{0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0, 0, {}, false, false}, _trace(nullptr), _source(nullptr),
+      _backend(counter_backend_t::automatic), _netlink_fd(-1), _netlink_seq(0),
+      _rx_bytes_file(sys_path("/sys/class/net/" + interface + "/statistics/rx_bytes")),
+      _tx_bytes_file(sys_path("/sys/class/net/" + interface + "/statistics/tx_bytes")),
+      _ifindex_file(sys_path("/sys/class/net/" + interface + "/ifindex")),
+      _carrier_changes_file(sys_path("/sys/class/net/" + interface + "/carrier_changes")),
+      _net_dev_file(sys_path("/proc/net/dev")), _identity_open_count(0) {
+    _net_dev_buffer.resize(4096);
+    if (_auto_capacity) {
+        _capacity_mbps = DEFAULT_CAPACITY_MBPS;
+        _direction_capacity_mbps = DEFAULT_CAPACITY_MBPS / 2;
+    }
+}
+
+bandwidth_monitor_t::~bandwidth_monitor_t() {
+    if (_netlink_fd >= 0) {
+        os_close(_netlink_fd);
+    }
+}
+
+bool bandwidth_monitor_t::set_counter_backend(const std::string& name) {
+    if (name == "auto") {
+        _backend = counter_backend_t::automatic;
+    } else if (name == "procfs") {
+        _backend = counter_backend_t::procfs;
+    } else if (name == "netlink") {
+        _backend = counter_backend_t::netlink;
+    } else {
+        return false;
+    }
+    return true;
 }
 
 bool bandwidth_monitor_t::initialize() {
     // Check if interface exists first
-    std::string sys_path = "/sys/class/net/" + _interface;
-    if (!std::filesystem::exists(sys_path)) {
-        syslog(LOG_ERR, "Network interface %s does not exist", _interface.c_str());
+    std::string interface_path = sys_path("/sys/class/net/" + _interface);
+    if (access(interface_path.c_str(), F_OK) != 0) {
+        os_syslog(LOG_ERR, "Network interface %s does not exist", _interface.c_str());
         return false;
     }
     
+    if (_auto_capacity) {
+        _capacity_mbps = 0;
+        if (!update_link_capacity()) {
+            _capacity_mbps = DEFAULT_CAPACITY_MBPS;
+            _direction_capacity_mbps = DEFAULT_CAPACITY_MBPS / 2;
+            os_syslog(LOG_WARNING, "Cannot detect link speed of %s, assuming %u Mbps until the link comes up",
+                      _interface.c_str(), _capacity_mbps);
+        }
+    }
+    
     _last_stats = read_network_stats();
     // Don't require non-zero bytes for initialization - interface might be idle
     _initialized = (_last_stats.rx_bytes != UINT64_MAX && _last_stats.tx_bytes != UINT64_MAX);
     
     if (_initialized) {
-        syslog(LOG_INFO, "Bandwidth monitor initialized for interface %s (capacity: %u Mbps, initial: RX=%lu, TX=%lu)",
-               _interface.c_str(), _capacity_mbps, _last_stats.rx_bytes, _last_stats.tx_bytes);
+        if (_trace) {
+            _trace->append(_last_stats);
+        }
+        os_syslog(LOG_INFO, "Bandwidth monitor initialized for interface %s (capacity: %u Mbps, initial: RX=%lu, TX=%lu)",
+                  _interface.c_str(), _capacity_mbps, _last_stats.rx_bytes, _last_stats.tx_bytes);
     } else {
-        syslog(LOG_ERR, "Failed to read initial stats for interface %s", _interface.c_str());
+        os_syslog(LOG_ERR, "Failed to read initial stats for interface %s", _interface.c_str());
     }
     
     return _initialized;
 }
 
+bool bandwidth_monitor_t::initialize_from(const network_stats_t& stats) {
+    _last_stats = stats;
+    _initialized = true;
+    return true;
+}
+
+void bandwidth_monitor_t::set_trace(counter_trace_t* trace) {
+    _trace = trace;
+    // Rates are computed against the reference sample, a replay needs it too
+    if (_trace && _initialized) {
+        _trace->append(_last_stats);
+    }
+}
+
 bandwidth_info_t bandwidth_monitor_t::get_bandwidth_usage() {
-    bandwidth_info_t result = {0.0, 0.0, 0.0, 0.0, false};
-    
     if (!_initialized) {
-        return result;
+        return bandwidth_info_t{0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0, 0, {}, false, false};
     }
     
     network_stats_t current_stats = read_network_stats();
+    if (_trace && current_stats.rx_bytes != UINT64_MAX && current_stats.tx_bytes != UINT64_MAX) {
+        _trace->append(current_stats);
+    }
+    
+    return compute_usage(current_stats);
+}
+
+bandwidth_info_t bandwidth_monitor_t::compute_usage(const network_stats_t& current_stats) {
+    bandwidth_info_t result = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0, 0,
+                               current_stats.timestamp, false, false};
+    
     if (current_stats.rx_bytes == UINT64_MAX || current_stats.tx_bytes == UINT64_MAX) {
         return result;
     }
     
     // Calculate time difference in seconds
-    auto time_diff = std::chrono::duration_cast<std::chrono::milliseconds>(
+    auto time_diff = std::chrono::duration_cast<std::chrono::microseconds>(
         current_stats.timestamp - _last_stats.timestamp).count();
     
-    // Require at least 100ms between measurements to avoid division by zero
-    // and ensure meaningful bandwidth calculations
-    if (time_diff < 100) {
+    // Require at least 10ms between measurements to avoid division by zero
+    // and ensure meaningful bandwidth calculations (peak-hold samples at 20ms+)
+    if (time_diff < 10000) {
         return result;
     }
     
-    double seconds = time_diff / 1000.0;
+    double seconds = time_diff / 1000000.0;
+    
+    // Interface re-created, driver reloaded or link bounced with a counter drop:
+    // the previous sample is meaningless, start over from the current one
+    if (is_counter_reset(current_stats, seconds)) {
+        _last_stats = current_stats;
+        result.resynced = true;
+        return result;
+    }
     
     // Calculate byte differences (handle counter wraparound)
-    uint64_t rx_diff = (current_stats.rx_bytes >= _last_stats.rx_bytes) ?
-        current_stats.rx_bytes - _last_stats.rx_bytes :
-        (UINT64_MAX - _last_stats.rx_bytes) + current_stats.rx_bytes;
-        
-    uint64_t tx_diff = (current_stats.tx_bytes >= _last_stats.tx_bytes) ?
-        current_stats.tx_bytes - _last_stats.tx_bytes :
-        (UINT64_MAX - _last_stats.tx_bytes) + current_stats.tx_bytes;
+    uint64_t max_bytes = max_bytes_for(seconds);
+    uint64_t rx_diff = 0, tx_diff = 0;
+    compute_delta(_last_stats.rx_bytes, current_stats.rx_bytes, max_bytes, rx_diff);
+    compute_delta(_last_stats.tx_bytes, current_stats.tx_bytes, max_bytes, tx_diff);
     
     // Convert to Mbps (bytes/sec * 8 bits/byte / 1,000,000 bits/Mbps)
     result.rx_mbps = (rx_diff * 8.0) / (seconds * 1000000.0);
     result.tx_mbps = (tx_diff * 8.0) / (seconds * 1000000.0);
     result.total_mbps = result.rx_mbps + result.tx_mbps;
+    result.rx_bytes = rx_diff;
+    result.tx_bytes = tx_diff;
+    
+    if (_last_stats.has_extended && current_stats.has_extended) {
+        auto rate = [this, seconds](uint64_t last, uint64_t current) {
+            uint64_t diff = 0;
+            compute_delta(last, current, UINT64_MAX, diff);
+            return diff / seconds;
+        };
+        
+        result.rx_pps = rate(_last_stats.rx_packets, current_stats.rx_packets);
+        result.tx_pps = rate(_last_stats.tx_packets, current_stats.tx_packets);
+        result.rx_errors_ps = rate(_last_stats.rx_errors, current_stats.rx_errors);
+        result.tx_errors_ps = rate(_last_stats.tx_errors, current_stats.tx_errors);
+        result.rx_drops_ps = rate(_last_stats.rx_dropped, current_stats.rx_dropped);
+        result.tx_drops_ps = rate(_last_stats.tx_dropped, current_stats.tx_dropped);
+        result.fifo_ps = rate(_last_stats.rx_fifo, current_stats.rx_fifo) +
+                         rate(_last_stats.tx_fifo, current_stats.tx_fifo);
+    }
     
     // Calculate usage percentage
     result.usage_percentage = (result.total_mbps / _capacity_mbps) * 100.0;
@@ -82,84 +183,339 @@ bandwidth_info_t bandwidth_monitor_t::get_bandwidth_usage() {
     return result;
 }
 
-network_stats_t bandwidth_monitor_t::read_network_stats() {
-    network_stats_t stats = {UINT64_MAX, UINT64_MAX, std::chrono::steady_clock::now()};
+bool bandwidth_monitor_t::update_link_capacity() {
+    if (!_auto_capacity) {
+        return false;
+    }
     
-    // Try /sys/class/net first (more reliable)
-    if (parse_sys_class_net(_interface, stats)) {
-        return stats;
+    std::string base = sys_path("/sys/class/net/" + _interface + "/");
+    
+    // Reading speed fails with EINVAL while the link is down
+    char buf[32];
+    int speed = -1;
+    if (!read_small_file(base + "speed", buf, sizeof(buf)) ||
+        std::from_chars(buf, buf + strlen(buf), speed).ec != std::errc() || speed <= 0) {
+        return false;
     }
     
-    // Fallback to /proc/net/dev
-    if (parse_proc_net_dev(_interface, stats)) {
-        return stats;
+    char duplex[16] = "";
+    if (read_small_file(base + "duplex", duplex, sizeof(duplex))) {
+        duplex[strcspn(duplex, "\n")] = '\0';
     }
     
-    syslog(LOG_WARNING, "Failed to read network stats for interface %s", _interface.c_str());
-    return stats;
+    // Capacity is the sum of both directions on a full duplex link
+    uint32_t capacity = (strcmp(duplex, "half") == 0) ? (uint32_t)speed : (uint32_t)speed * 2;
+    if (capacity == _capacity_mbps) {
+        return false;
+    }
+    
+    os_syslog(LOG_INFO, "Link %s negotiated %d Mbps %s duplex, capacity %u Mbps",
+              _interface.c_str(), speed, duplex[0] ? duplex : "unknown", capacity);
+    _capacity_mbps = capacity;
+    _direction_capacity_mbps = speed;
+    return true;
 }
 
-bool bandwidth_monitor_t::parse_sys_class_net(const std::string& interface, network_stats_t& stats) {
-    std::string rx_path = "/sys/class/net/" + interface + "/statistics/rx_bytes";
-    std::string tx_path = "/sys/class/net/" + interface + "/statistics/tx_bytes";
-    
-    std::ifstream rx_file(rx_path);
-    std::ifstream tx_file(tx_path);
+bool bandwidth_monitor_t::is_counter_reset(const network_stats_t& current, double seconds) {
+    if (current.ifindex != 0 && _last_stats.ifindex != 0 && current.ifindex != _last_stats.ifindex) {
+        os_syslog(LOG_INFO, "Interface %s was re-created (ifindex %d -> %d), resynchronising counters",
+                  _interface.c_str(), _last_stats.ifindex, current.ifindex);
+        return true;
+    }
     
-    if (!rx_file.is_open() || !tx_file.is_open()) {
+    bool decreased = current.rx_bytes < _last_stats.rx_bytes || current.tx_bytes < _last_stats.tx_bytes;
+    if (!decreased) {
         return false;
     }
     
-    std::string rx_str, tx_str;
-    if (!std::getline(rx_file, rx_str) || !std::getline(tx_file, tx_str)) {
-        return false;
+    if (current.carrier_changes != _last_stats.carrier_changes) {
+        os_syslog(LOG_INFO, "Counters of %s dropped after a carrier change, resynchronising",
+                  _interface.c_str());
+        return true;
     }
     
-    try {
-        stats.rx_bytes = std::stoull(rx_str);
-        stats.tx_bytes = std::stoull(tx_str);
-        stats.timestamp = std::chrono::steady_clock::now();
+    // No identity change: it is only a wrap if the wrapped delta is plausible for the link
+    uint64_t max_bytes = max_bytes_for(seconds);
+    uint64_t diff;
+    if (!compute_delta(_last_stats.rx_bytes, current.rx_bytes, max_bytes, diff) ||
+        !compute_delta(_last_stats.tx_bytes, current.tx_bytes, max_bytes, diff)) {
+        os_syslog(LOG_INFO, "Counters of %s dropped (RX %lu -> %lu, TX %lu -> %lu), resynchronising",
+                  _interface.c_str(), _last_stats.rx_bytes, current.rx_bytes,
+                  _last_stats.tx_bytes, current.tx_bytes);
         return true;
-    } catch (const std::exception& e) {
-        syslog(LOG_WARNING, "Failed to parse network stats from sysfs: %s", e.what());
+    }
+    
+    return false;
+}
+
+uint64_t bandwidth_monitor_t::max_bytes_for(double seconds) const {
+    // Twice the configured capacity leaves room for a misconfigured capacity_mbps
+    return (uint64_t)(seconds * _capacity_mbps * 1000000.0 / 8.0 * 2.0);
+}
+
+bool bandwidth_monitor_t::compute_delta(uint64_t last, uint64_t current, uint64_t max_bytes, uint64_t& diff) {
+    if (current >= last) {
+        diff = current - last;
+        return true;
+    }
+    
+    // Drivers expose either 32 or 64 bit counters, accept whichever wrap is plausible
+    if (last <= UINT32_MAX && current <= UINT32_MAX) {
+        uint64_t wrapped = ((uint64_t)UINT32_MAX - last) + current + 1;
+        if (wrapped <= max_bytes) {
+            diff = wrapped;
+            return true;
+        }
+    }
+    
+    uint64_t wrapped = (UINT64_MAX - last) + current + 1;
+    if (wrapped <= max_bytes) {
+        diff = wrapped;
+        return true;
+    }
+    
+    diff = 0;
+    return false;
+}
+
+uint32_t bandwidth_monitor_t::get_open_count() const {
+    return _rx_bytes_file.get_open_count() + _tx_bytes_file.get_open_count() + _ifindex_file.get_open_count();
+}
+
+void bandwidth_monitor_t::read_link_identity(network_stats_t& stats) {
+    // The identity only matters when the counters went backwards or when the
+    // held descriptors had to be reopened, which is how a re-created interface
+    // shows up; otherwise it is carried over and costs no reads
+    if (_initialized && get_open_count() == _identity_open_count &&
+        stats.rx_bytes >= _last_stats.rx_bytes && stats.tx_bytes >= _last_stats.tx_bytes) {
+        if (stats.ifindex == 0) {
+            stats.ifindex = _last_stats.ifindex;
+        }
+        stats.carrier_changes = _last_stats.carrier_changes;
+        return;
+    }
+    
+    uint64_t ifindex;
+    if (stats.ifindex == 0 && _ifindex_file.read_uint64(ifindex)) {
+        stats.ifindex = (int)ifindex;
+    }
+    
+    if (!_carrier_changes_file.read_uint64(stats.carrier_changes)) {
+        stats.carrier_changes = UINT64_MAX;
+    }
+    _identity_open_count = get_open_count();
+}
+
+bool bandwidth_monitor_t::read() {
+    _info = get_bandwidth_usage();
+    return _info.valid;
+}
+
+network_stats_t bandwidth_monitor_t::read_network_stats() {
+    network_stats_t stats = {UINT64_MAX, UINT64_MAX, 0, 0, 0, 0, 0, 0, 0, 0, false, 0, UINT64_MAX,
+                             std::chrono::steady_clock::now()};
+    if (_source) {
+        _source->read(stats);
+        return stats;
+    }
+    
+    // Netlink also carries the ifindex and carrier changes, no sysfs reads at all
+    if (_backend == counter_backend_t::netlink && parse_netlink(_interface, stats)) {
+        return stats;
+    }
+    
+    // /proc/net/dev has every counter on one line, a single read beats one sysfs file per counter
+    bool found = (_extended_counters || _backend == counter_backend_t::procfs) && parse_proc_net_dev(stats);
+    
+    // Try /sys/class/net first (more reliable), fall back to /proc/net/dev
+    if (!found) {
+        found = parse_sys_class_net(stats) || parse_proc_net_dev(stats);
+    }
+    
+    if (!found) {
+        os_syslog(LOG_WARNING, "Failed to read network stats for interface %s", _interface.c_str());
+        return stats;
+    }
+    
+    read_link_identity(stats);
+    return stats;
+}
+
+bool bandwidth_monitor_t::parse_sys_class_net(network_stats_t& stats) {
+    uint64_t rx_bytes, tx_bytes;
+    if (!_rx_bytes_file.read_uint64(rx_bytes) || !_tx_bytes_file.read_uint64(tx_bytes)) {
         return false;
     }
+    
+    stats.rx_bytes = rx_bytes;
+    stats.tx_bytes = tx_bytes;
+    stats.timestamp = std::chrono::steady_clock::now();
+    return true;
 }
 
-bool bandwidth_monitor_t::parse_proc_net_dev(const std::string& interface, network_stats_t& stats) {
-    std::ifstream file("/proc/net/dev");
-    if (!file.is_open()) {
+bool bandwidth_monitor_t::parse_proc_net_dev(network_stats_t& stats) {
+    if (!_net_dev_file.read(_net_dev_buffer) || !parse_net_dev(_net_dev_buffer.data(), _interface, stats)) {
         return false;
     }
+    stats.timestamp = std::chrono::steady_clock::now();
     
-    std::string line;
-    // Skip header lines
-    std::getline(file, line);
-    std::getline(file, line);
+    // /proc/net/dev stays readable when the interface is re-created, the
+    // held ifindex attribute does not
+    uint64_t ifindex;
+    if (_ifindex_file.read_uint64(ifindex)) {
+        stats.ifindex = (int)ifindex;
+    }
+    return true;
+}
+
+bool bandwidth_monitor_t::parse_net_dev(const char* text, const std::string& interface, network_stats_t& stats) {
+    // Skip the two header lines
+    const char* line = text;
+    for (int i = 0; i < 2 && line; ++i) {
+        line = strchr(line, '\n');
+        if (line) {
+            ++line;
+        }
+    }
     
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string iface_name;
+    while (line && *line) {
+        const char* eol = strchr(line, '\n');
+        const char* end = eol ? eol : line + strlen(line);
         
-        // Extract interface name (remove colon)
-        if (!(iss >> iface_name)) continue;
-        if (iface_name.back() == ':') {
-            iface_name.pop_back();
+        // "  eth0: 1234 ..." (long names touch the colon and the first number)
+        const char* colon = (const char*)memchr(line, ':', end - line);
+        const char* name = line;
+        while (name < end && *name == ' ') ++name;
+        
+        if (colon && (size_t)(colon - name) == interface.size() &&
+            memcmp(name, interface.data(), interface.size()) == 0) {
+            // RX: bytes packets errs drop fifo frame compressed multicast, TX: bytes packets errs drop fifo ...
+            uint64_t fields[13];
+            int count = 0;
+            const char* pos = colon + 1;
+            while (count < 13) {
+                char* next;
+                fields[count] = strtoull(pos, &next, 10);
+                if (next == pos || next > end) {
+                    break;
+                }
+                pos = next;
+                ++count;
+            }
+            
+            if (count < 9) {
+                return false;
+            }
+            
+            stats.rx_bytes = fields[0];
+            stats.tx_bytes = fields[8];
+            
+            if (count == 13) {
+                stats.rx_packets = fields[1];
+                stats.tx_packets = fields[9];
+                stats.rx_errors = fields[2];
+                stats.tx_errors = fields[10];
+                stats.rx_dropped = fields[3];
+                stats.tx_dropped = fields[11];
+                stats.rx_fifo = fields[4];
+                stats.tx_fifo = fields[12];
+                stats.has_extended = true;
+            }
+            return true;
         }
         
-        if (iface_name != interface) continue;
+        line = eol ? eol + 1 : nullptr;
+    }
+    
+    return false;
+}
+
+bool bandwidth_monitor_t::parse_netlink(const std::string& interface, network_stats_t& stats) {
+    if (interface.size() >= IFNAMSIZ) {
+        return false;
+    }
+    
+    if (_netlink_fd < 0) {
+        _netlink_fd = os_socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (_netlink_fd < 0) {
+            os_syslog(LOG_WARNING, "Failed to open netlink socket: %s, using sysfs counters", strerror(errno));
+            _backend = counter_backend_t::automatic;
+            return false;
+        }
+        _netlink_buffer.resize(NETLINK_BUFFER_SIZE);
+    }
+    
+    // Ask for the one link by name, the reply has the ifindex and all counters
+    struct {
+        nlmsghdr header;
+        ifinfomsg info;
+        char attributes[RTA_SPACE(IFNAMSIZ)];
+    } request;
+    memset(&request, 0, sizeof(request));
+    
+    rtattr* name = (rtattr*)request.attributes;
+    name->rta_type = IFLA_IFNAME;
+    name->rta_len = RTA_LENGTH(interface.size() + 1);
+    memcpy(RTA_DATA(name), interface.c_str(), interface.size() + 1);
+    
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(ifinfomsg)) + RTA_ALIGN(name->rta_len);
+    request.header.nlmsg_type = RTM_GETLINK;
+    request.header.nlmsg_flags = NLM_F_REQUEST;
+    request.header.nlmsg_seq = ++_netlink_seq;
+    request.info.ifi_family = AF_UNSPEC;
+    
+    if (os_send(_netlink_fd, &request, request.header.nlmsg_len, 0) < 0) {
+        return false;
+    }
+    
+    // The kernel answers from within send(), so the reply is already queued
+    ssize_t len = os_recv(_netlink_fd, _netlink_buffer.data(), _netlink_buffer.size(), MSG_DONTWAIT | MSG_TRUNC);
+    if (len < 0 || (size_t)len > _netlink_buffer.size()) {
+        return false;
+    }
+    
+    bool found = false;
+    int remaining = (int)len;
+    for (nlmsghdr* header = (nlmsghdr*)_netlink_buffer.data(); NLMSG_OK(header, remaining);
+         header = NLMSG_NEXT(header, remaining)) {
+        if (header->nlmsg_seq != _netlink_seq || header->nlmsg_type != RTM_NEWLINK) {
+            continue;
+        }
         
-        // Parse the stats (rx_bytes is first, tx_bytes is 9th field after interface name)
-        uint64_t rx_bytes, rx_packets, rx_errs, rx_drop, rx_fifo, rx_frame, rx_compressed, rx_multicast;
-        uint64_t tx_bytes;
+        ifinfomsg* info = (ifinfomsg*)NLMSG_DATA(header);
+        stats.ifindex = info->ifi_index;
         
-        if (iss >> rx_bytes >> rx_packets >> rx_errs >> rx_drop >> rx_fifo >> rx_frame >> rx_compressed >> rx_multicast >> tx_bytes) {
-            stats.rx_bytes = rx_bytes;
-            stats.tx_bytes = tx_bytes;
-            stats.timestamp = std::chrono::steady_clock::now();
-            return true;
+        int attributes_len = IFLA_PAYLOAD(header);
+        for (rtattr* attribute = IFLA_RTA(info); RTA_OK(attribute, attributes_len);
+             attribute = RTA_NEXT(attribute, attributes_len)) {
+            if (attribute->rta_type == IFLA_STATS64 && RTA_PAYLOAD(attribute) >= sizeof(rtnl_link_stats64)) {
+                // Attributes are only 4 byte aligned
+                rtnl_link_stats64 link_stats;
+                memcpy(&link_stats, RTA_DATA(attribute), sizeof(link_stats));
+                
+                // Same meaning as the /proc/net/dev columns
+                stats.rx_bytes = link_stats.rx_bytes;
+                stats.tx_bytes = link_stats.tx_bytes;
+                stats.rx_packets = link_stats.rx_packets;
+                stats.tx_packets = link_stats.tx_packets;
+                stats.rx_errors = link_stats.rx_errors;
+                stats.tx_errors = link_stats.tx_errors;
+                stats.rx_dropped = link_stats.rx_dropped + link_stats.rx_missed_errors;
+                stats.tx_dropped = link_stats.tx_dropped;
+                stats.rx_fifo = link_stats.rx_fifo_errors;
+                stats.tx_fifo = link_stats.tx_fifo_errors;
+                stats.has_extended = true;
+                found = true;
+            } else if (attribute->rta_type == IFLA_CARRIER_CHANGES && RTA_PAYLOAD(attribute) >= sizeof(uint32_t)) {
+                uint32_t carrier_changes;
+                memcpy(&carrier_changes, RTA_DATA(attribute), sizeof(carrier_changes));
+                stats.carrier_changes = carrier_changes;
+            }
         }
     }
     
-    return false;
-}
\ No newline at end of file
+    if (found) {
+        stats.timestamp = std::chrono::steady_clock::now();
+    }
+    return found;
+}
@@ -2,11 +2,30 @@
 #define __LEDCTL_BANDWIDTH_MONITOR_H__
 
 #include <string>
+#include <vector>
 #include <chrono>
 
+#include "metric_source.h"
+#include "sys_root.h"
+
+// Capacity used when the link speed cannot be detected (1Gbps full duplex)
+const uint32_t DEFAULT_CAPACITY_MBPS = 2000;
+
 struct network_stats_t {
     uint64_t rx_bytes;
     uint64_t tx_bytes;
+    // Extended counters, only read when enabled
+    uint64_t rx_packets;
+    uint64_t tx_packets;
+    uint64_t rx_errors;
+    uint64_t tx_errors;
+    uint64_t rx_dropped;
+    uint64_t tx_dropped;
+    uint64_t rx_fifo;            // FIFO overruns
+    uint64_t tx_fifo;
+    bool has_extended;
+    int ifindex;                 // 0 if unknown
+    uint64_t carrier_changes;    // UINT64_MAX if unknown
     std::chrono::steady_clock::time_point timestamp;
 };
 
@@ -15,22 +34,95 @@ struct bandwidth_info_t {
     double tx_mbps;
     double total_mbps;
     double usage_percentage;
+    double rx_pps;
+    double tx_pps;
+    double rx_errors_ps;
+    double tx_errors_ps;
+    double rx_drops_ps;
+    double tx_drops_ps;
+    double fifo_ps;              // RX + TX FIFO overruns per second
+    uint64_t rx_bytes;           // bytes since the previous sample
+    uint64_t tx_bytes;
+    std::chrono::steady_clock::time_point timestamp;  // when the counters were read
     bool valid;
+    bool resynced;   // counters were reset, sample discarded (not a failure)
+};
+
+class counter_trace_t;
+
+// Stands in for the kernel's counters, e.g. a simulated traffic step in the
+// latency benchmark. Fills in the counters and the timestamp.
+class counter_source_t {
+public:
+    virtual ~counter_source_t() {}
+    virtual bool read(network_stats_t& stats) = 0;
+};
+
+// Where the counters come from
+enum class counter_backend_t {
+    automatic,      // sysfs, /proc/net/dev when extended counters are needed
+    procfs,         // /proc/net/dev
+    netlink         // RTM_GETLINK with IFLA_STATS64 on a socket kept open
 };
 
-class bandwidth_monitor_t {
+// Reads the interface counters and turns them into rates. As a metric_input_t
+// it is refreshed at most once per scheduler tick, however many sources use it.
+class bandwidth_monitor_t : public metric_input_t {
 private:
     std::string _interface;
     uint32_t _capacity_mbps;
+    uint32_t _direction_capacity_mbps;
+    bool _auto_capacity;
     network_stats_t _last_stats;
     bool _initialized;
+    bool _extended_counters;
+    bandwidth_info_t _info;       // result of the last refresh()
+    counter_trace_t* _trace;      // records every sample when set
+    counter_source_t* _source;    // replaces the backends when set
+    counter_backend_t _backend;
+    int _netlink_fd;
+    uint32_t _netlink_seq;
+    std::vector<char> _netlink_buffer;
+    
+    // Counter files, kept open so that a sample is one pread per file
+    sys_file_t _rx_bytes_file;
+    sys_file_t _tx_bytes_file;
+    sys_file_t _ifindex_file;
+    sys_file_t _carrier_changes_file;
+    sys_file_t _net_dev_file;
+    std::vector<char> _net_dev_buffer;      // grows to fit /proc/net/dev, then reused
+    uint32_t _identity_open_count;          // opens of the sysfs files when the identity was last read
+    
+    uint32_t get_open_count() const;
+    void read_link_identity(network_stats_t& stats);
+    bool is_counter_reset(const network_stats_t& current, double seconds);
+    bool compute_delta(uint64_t last, uint64_t current, uint64_t max_bytes, uint64_t& diff);
+    uint64_t max_bytes_for(double seconds) const;
+    bool parse_proc_net_dev(network_stats_t& stats);
+    bool parse_sys_class_net(network_stats_t& stats);
+    bool parse_netlink(const std::string& interface, network_stats_t& stats);
 
-    network_stats_t read_network_stats();
-    bool parse_proc_net_dev(const std::string& interface, network_stats_t& stats);
-    bool parse_sys_class_net(const std::string& interface, network_stats_t& stats);
+protected:
+    bool read() override;
 
 public:
     bandwidth_monitor_t(const std::string& interface, uint32_t capacity_mbps);
+    ~bandwidth_monitor_t();
+    
+    // "auto", "procfs" or "netlink", false if unknown
+    bool set_counter_backend(const std::string& name);
+    
+    // Read the raw counters through the selected backend
+    network_stats_t read_network_stats();
+    
+    // Parse the contents of /proc/net/dev
+    static bool parse_net_dev(const char* text, const std::string& interface, network_stats_t& stats);
+    
+    // Also read packet, error, drop and FIFO counters (switches to the single-read /proc/net/dev backend)
+    void enable_extended_counters() { _extended_counters = true; }
+    
+    // Result of the last refresh()
+    const bandwidth_info_t& get_info() const { return _info; }
     
     // Initialize the monitor (takes first measurement)
     bool initialize();
@@ -38,11 +130,32 @@ public:
     // Get current bandwidth usage
     bandwidth_info_t get_bandwidth_usage();
     
+    // When the sample the next rate is computed against was read
+    std::chrono::steady_clock::time_point get_reference_time() const { return _last_stats.timestamp; }
+    
+    // Replay: start from / compute rates against a given sample instead of the live counters
+    bool initialize_from(const network_stats_t& stats);
+    bandwidth_info_t compute_usage(const network_stats_t& current_stats);
+    
+    // Record every sample read from now on, starting with the reference
+    // sample if the monitor is already initialized
+    void set_trace(counter_trace_t* trace);
+    
+    // Read the counters from source instead of the system (start with initialize_from())
+    void set_counter_source(counter_source_t* source) { _source = source; }
+    
     // Get interface name
     const std::string& get_interface() const { return _interface; }
     
     // Get capacity
     uint32_t get_capacity_mbps() const { return _capacity_mbps; }
+    bool is_auto_capacity() const { return _auto_capacity; }
+    
+    // Capacity of a single direction (link speed)
+    uint32_t get_direction_capacity_mbps() const { return _direction_capacity_mbps; }
+    
+    // Re-read link speed and duplex (auto capacity only), returns true if the capacity changed
+    bool update_link_capacity();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "bus_lock.h"
+#include "led_controller.h"
+#include "os.h"
+#include <sys/file.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <cerrno>
+#include <cstring>
+
+// How often a taken lock is tried again
+#define BUS_LOCK_RETRY_US 5000
+
+bus_lock_t::~bus_lock_t() {
+    if (_fd >= 0) {
+        os_close(_fd);
+    }
+}
+
+bool bus_lock_t::open(const std::string& path, uint32_t timeout_ms) {
+    _path = path;
+    _timeout_ms = timeout_ms;
+    _fd = os_open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (_fd < 0) {
+        os_syslog(LOG_WARNING, "Cannot open the LED bus lock %s: %s, writing without it", path.c_str(), strerror(errno));
+        return false;
+    }
+    os_syslog(LOG_DEBUG, "Using LED bus lock %s", path.c_str());
+    return true;
+}
+
+bool bus_lock_t::acquire() {
+    if (_fd < 0 || _held) {
+        return true;
+    }
+    
+    // Other writers hold it for a command or a frame, so polling is good enough
+    uint32_t waited_us = 0;
+    while (os_flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+        if (errno != EWOULDBLOCK && errno != EINTR) {
+            os_syslog(LOG_WARNING, "Cannot lock %s: %s", _path.c_str(), strerror(errno));
+            return true;
+        }
+        if (waited_us == 0) {
+            ++_waits;
+        }
+        if (waited_us >= _timeout_ms * 1000) {
+            os_syslog(LOG_INFO, "LED bus is held by another tool for more than %u ms, retrying later", _timeout_ms);
+            return false;
+        }
+        os_sleep_us(BUS_LOCK_RETRY_US);
+        waited_us += BUS_LOCK_RETRY_US;
+    }
+    
+    _held = true;
+    return true;
+}
+
+bool bus_lock_t::try_acquire() {
+    if (_fd < 0 || _held) {
+        return true;
+    }
+    if (os_flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+        return errno != EWOULDBLOCK && errno != EINTR;
+    }
+    _held = true;
+    return true;
+}
+
+void bus_lock_t::release() {
+    if (_held) {
+        os_flock(_fd, LOCK_UN);
+        _held = false;
+    }
+}
+
+uint32_t led_lease_t::read() const {
+    int fd = os_open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    // Getting a shared lock means no tool holds it exclusively
+    uint32_t mask = 0;
+    if (os_flock(fd, LOCK_SH | LOCK_NB) == 0) {
+        os_flock(fd, LOCK_UN);
+    } else {
+        char buf[256];
+        ssize_t len = os_pread(fd, buf, sizeof(buf) - 1, 0);
+        buf[len > 0 ? len : 0] = '\0';
+        
+        for (char* save = nullptr, *name = strtok_r(buf, ", \t\n", &save); name;
+             name = strtok_r(nullptr, ", \t\n", &save)) {
+            led_controller_t::led_type_t id;
+            if (led_controller_t::parse_led_name(name, id)) {
+                mask |= 1u << (size_t)id;
+            }
+        }
+    }
+    os_close(fd);
+    return mask;
+}
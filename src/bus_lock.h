@@ -0,0 +1,61 @@
+#ifndef __LEDCTL_BUS_LOCK_H__
+#define __LEDCTL_BUS_LOCK_H__
+
+#include <string>
+#include <cstdint>
+
+// Advisory lock on the LED MCU shared with other tools that write to it
+// (ugreen_leds_cli, disk activity scripts): an exclusive flock on a
+// well-known file, held while one frame is written so that commands of
+// different writers do not interleave mid-frame.
+//
+//   flock /run/lock/ugreen-leds.lock ugreen_leds_cli disk1 -on
+class bus_lock_t {
+private:
+    std::string _path;
+    int _fd;
+    uint32_t _timeout_ms;
+    bool _held;
+    uint64_t _waits;
+
+public:
+    bus_lock_t() : _fd(-1), _timeout_ms(0), _held(false), _waits(0) {}
+    ~bus_lock_t();
+    bus_lock_t(const bus_lock_t&) = delete;
+    bus_lock_t& operator=(const bus_lock_t&) = delete;
+    
+    // Open (create) the lock file, false if it cannot be opened
+    bool open(const std::string& path, uint32_t timeout_ms);
+    bool is_open() const { return _fd >= 0; }
+    
+    // Take the lock, waiting up to the timeout for another writer to finish.
+    // Always succeeds without a lock file.
+    bool acquire();
+    void release();
+    
+    // Take the lock only if nobody holds it, for work that can be put off
+    bool try_acquire();
+    
+    // Acquisitions that found the bus taken
+    uint64_t get_wait_count() const { return _waits; }
+};
+
+// A lease another tool takes on some LEDs: it holds an exclusive flock on
+// the lease file for as long as it drives them and lists their names in it,
+// comma or space separated. A lease file nobody holds is ignored, so a tool
+// that dies gives its LEDs back.
+//
+//   exec 9> /run/lock/ugreen-leds.lease && flock 9 && echo disk1,disk2 >&9
+class led_lease_t {
+private:
+    std::string _path;
+
+public:
+    void set_path(const std::string& path) { _path = path; }
+    bool is_enabled() const { return !_path.empty(); }
+    
+    // Bit mask of the leased LEDs (1 << led_type_t), 0 while nobody holds the lease
+    uint32_t read() const;
+};
+
+#endif
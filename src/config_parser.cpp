@@ -1,34 +1,36 @@
 #include "config_parser.h"
-#include <fstream>
-#include <sstream>
-#include <filesystem>
+#include "os.h"
 #include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
 #include <syslog.h>
+#include <unistd.h>
 
 bool config_parser_t::load_config(ledctl_config_t& config) {
     // Try local config first
-    if (std::filesystem::exists("./ugreen_leds_ethutild.conf")) {
+    if (access("./ugreen_leds_ethutild.conf", F_OK) == 0) {
         if (load_config_from_file("./ugreen_leds_ethutild.conf", config)) {
-            syslog(LOG_INFO, "Loaded configuration from ./ugreen_leds_ethutild.conf");
+            os_syslog(LOG_INFO, "Loaded configuration from ./ugreen_leds_ethutild.conf");
             return true;
         }
     }
     
     // Try system config
-    if (std::filesystem::exists("/etc/ugreen_leds_ethutild.conf")) {
+    if (access("/etc/ugreen_leds_ethutild.conf", F_OK) == 0) {
         if (load_config_from_file("/etc/ugreen_leds_ethutild.conf", config)) {
-            syslog(LOG_INFO, "Loaded configuration from /etc/ugreen_leds_ethutild.conf");
+            os_syslog(LOG_INFO, "Loaded configuration from /etc/ugreen_leds_ethutild.conf");
             return true;
         }
     }
     
-    syslog(LOG_INFO, "No configuration file found, using defaults");
+    os_syslog(LOG_INFO, "No configuration file found, using defaults");
     return true; // Use defaults
 }
 
 bool config_parser_t::load_config_from_file(const std::string& filename, ledctl_config_t& config) {
     if (!parse_file(filename)) {
-        syslog(LOG_ERR, "Failed to parse configuration file: %s", filename.c_str());
+        os_syslog(LOG_ERR, "Failed to parse configuration file: %s", filename.c_str());
         return false;
     }
     
@@ -38,73 +40,180 @@ bool config_parser_t::load_config_from_file(const std::string& filename, ledctl_
         config.interface = interface;
     }
     
-    std::string capacity_str = get_value("network", "capacity_mbps");
-    if (!capacity_str.empty()) {
-        try {
-            config.capacity_mbps = std::stoul(capacity_str);
-        } catch (const std::exception& e) {
-            syslog(LOG_WARNING, "Invalid capacity_mbps value: %s, using default", capacity_str.c_str());
-        }
+    if (get_value("network", "capacity_mbps") == "auto") {
+        config.capacity_mbps = 0;
+    } else {
+        get_uint_value("network", "capacity_mbps", 0, UINT32_MAX, config.capacity_mbps);
+    }
+    
+    std::string counters = get_value("network", "counters", config.counters);
+    if (counters == "auto" || counters == "procfs" || counters == "netlink") {
+        config.counters = counters;
+    } else {
+        os_syslog(LOG_WARNING, "Invalid counters value: %s, using default", counters.c_str());
     }
     
     // Parse LED settings
-    std::string brightness_str = get_value("leds", "brightness");
-    if (!brightness_str.empty()) {
-        try {
-            int brightness = std::stoi(brightness_str);
-            if (brightness >= 0 && brightness <= 255) {
-                config.brightness = static_cast<uint8_t>(brightness);
-            } else {
-                syslog(LOG_WARNING, "Brightness value out of range (0-255): %d, using default", brightness);
-            }
-        } catch (const std::exception& e) {
-            syslog(LOG_WARNING, "Invalid brightness value: %s, using default", brightness_str.c_str());
+    uint32_t brightness = config.brightness;
+    get_uint_value("leds", "brightness", 0, 255, brightness);
+    config.brightness = static_cast<uint8_t>(brightness);
+    
+    // Parse threshold settings
+    get_threshold_value("leds", "low_threshold", config.low_threshold);
+    get_threshold_value("leds", "medium_threshold", config.medium_threshold);
+    get_threshold_value("leds", "high_threshold", config.high_threshold);
+    
+    // Parse custom levels
+    for (const std::string& name : get_section_names("level.")) {
+        led_level_t level;
+        if (parse_level(name, config.brightness, level)) {
+            config.levels.push_back(level);
         }
     }
     
-    // Parse threshold settings
-    std::string low_threshold_str = get_value("leds", "low_threshold");
-    if (!low_threshold_str.empty()) {
-        try {
-            int threshold = std::stoi(low_threshold_str);
-            if (threshold >= 0 && threshold <= 100) {
-                config.low_threshold = static_cast<uint8_t>(threshold);
-            } else {
-                syslog(LOG_WARNING, "Low threshold value out of range (0-100): %d, using default", threshold);
+    // The first lit level is what counts as idle for adaptive polling
+    if (!config.levels.empty()) {
+        uint8_t first_lit = 100;
+        for (const led_level_t& level : config.levels) {
+            if (level.leds && level.threshold < first_lit) {
+                first_lit = level.threshold;
             }
-        } catch (const std::exception& e) {
-            syslog(LOG_WARNING, "Invalid low_threshold value: %s, using default", low_threshold_str.c_str());
         }
+        config.low_threshold = first_lit;
     }
     
-    std::string medium_threshold_str = get_value("leds", "medium_threshold");
-    if (!medium_threshold_str.empty()) {
-        try {
-            int threshold = std::stoi(medium_threshold_str);
-            if (threshold >= 0 && threshold <= 100) {
-                config.medium_threshold = static_cast<uint8_t>(threshold);
-            } else {
-                syslog(LOG_WARNING, "Medium threshold value out of range (0-100): %d, using default", threshold);
-            }
-        } catch (const std::exception& e) {
-            syslog(LOG_WARNING, "Invalid medium_threshold value: %s, using default", medium_threshold_str.c_str());
+    // Parse display settings
+    std::string display_mode = get_value("leds", "mode", config.display_mode);
+    if (display_mode == "combined" || display_mode == "per_direction") {
+        config.display_mode = display_mode;
+    } else {
+        os_syslog(LOG_WARNING, "Invalid mode value: %s, using default", display_mode.c_str());
+    }
+    config.rx_led = get_value("leds", "rx_led", config.rx_led);
+    config.tx_led = get_value("leds", "tx_led", config.tx_led);
+    
+    // The MCU's bus: a fixed i2c-N, or found by adapter name
+    std::string i2c_bus = get_value("leds", "i2c_bus", "auto");
+    if (i2c_bus != "auto") {
+        uint32_t bus = UINT32_MAX;
+        get_uint_value("leds", "i2c_bus", 0, 1023, bus);
+        config.led_bus.bus = bus == UINT32_MAX ? -1 : (int)bus;
+    }
+    std::string i2c_address = get_value("leds", "i2c_address");
+    if (!i2c_address.empty()) {
+        // 7-bit address, usually written in hex
+        bool hex = i2c_address.compare(0, 2, "0x") == 0 || i2c_address.compare(0, 2, "0X") == 0;
+        const char* begin = i2c_address.c_str() + (hex ? 2 : 0);
+        const char* end = i2c_address.c_str() + i2c_address.size();
+        uint32_t address = 0;
+        auto result = std::from_chars(begin, end, address, hex ? 16 : 10);
+        if (result.ec == std::errc() && result.ptr == end && address >= 0x03 && address <= 0x77) {
+            config.led_bus.address = (uint8_t)address;
+        } else {
+            os_syslog(LOG_WARNING, "Invalid i2c_address value: %s, using default", i2c_address.c_str());
         }
     }
+    std::vector<std::string> adapters = get_list_value("leds", "i2c_adapters");
+    if (!adapters.empty()) {
+        config.led_bus.adapters = adapters;
+    }
+    std::string i2c_cache = get_value("leds", "i2c_cache", config.led_bus.cache_path);
+    config.led_bus.cache_path = i2c_cache == "off" ? "" : i2c_cache;
+    std::string i2c_lock = get_value("leds", "i2c_lock", config.led_bus.lock_path);
+    config.led_bus.lock_path = i2c_lock == "off" ? "" : i2c_lock;
+    get_uint_value("leds", "i2c_lock_timeout_ms", 0, 10000, config.led_bus.lock_timeout_ms);
+    std::string yield_lease = get_value("leds", "yield_lease", "off");
+    config.yield_lease = yield_lease == "off" ? "" : yield_lease;
+    get_uint_value("leds", "readback_bytes_per_s", 0, 1000, config.readback_bytes_per_s);
     
-    std::string high_threshold_str = get_value("leds", "high_threshold");
-    if (!high_threshold_str.empty()) {
-        try {
-            int threshold = std::stoi(high_threshold_str);
-            if (threshold >= 0 && threshold <= 100) {
-                config.high_threshold = static_cast<uint8_t>(threshold);
-            } else {
-                syslog(LOG_WARNING, "High threshold value out of range (0-100): %d, using default", threshold);
-            }
-        } catch (const std::exception& e) {
-            syslog(LOG_WARNING, "Invalid high_threshold value: %s, using default", high_threshold_str.c_str());
+    // Per-direction thresholds default to the combined ones
+    config.rx_low_threshold = config.tx_low_threshold = config.low_threshold;
+    config.rx_medium_threshold = config.tx_medium_threshold = config.medium_threshold;
+    config.rx_high_threshold = config.tx_high_threshold = config.high_threshold;
+    
+    const char* directions[] = {"rx", "tx"};
+    for (const char* direction : directions) {
+        bool rx = direction[0] == 'r';
+        uint32_t& capacity = rx ? config.rx_capacity_mbps : config.tx_capacity_mbps;
+        if (get_value(direction, "capacity_mbps") == "auto") {
+            capacity = 0;
+        } else {
+            get_uint_value(direction, "capacity_mbps", 0, UINT32_MAX, capacity);
         }
+        get_threshold_value(direction, "low_threshold", rx ? config.rx_low_threshold : config.tx_low_threshold);
+        get_threshold_value(direction, "medium_threshold", rx ? config.rx_medium_threshold : config.tx_medium_threshold);
+        get_threshold_value(direction, "high_threshold", rx ? config.rx_high_threshold : config.tx_high_threshold);
     }
     
+    // Parse peak-hold settings
+    get_bool_value("peak", "enabled", config.peak_enabled);
+    get_uint_value("peak", "sample_ms", 20, 1000, config.peak_sample_ms);
+    get_uint_value("peak", "hold_ms", 0, 60000, config.peak_hold_ms);
+    get_uint_value("peak", "decay_percentage", 1, 10000, config.peak_decay_percentage);
+    get_uint_value("peak", "min_update_ms", 0, 10000, config.peak_min_update_ms);
+    
+    // Parse disk settings
+    get_bool_value("disks", "enabled", config.disks_enabled);
+    get_uint_value("disks", "capacity_mbs", 1, 100000, config.disk_capacity_mbs);
+    config.disk_ports = get_value("disks", "ports", config.disk_ports);
+    
+    // Parse metric source settings
+    get_uint_value("sources", "network_period_ms", 0, 600000, config.network_period_ms);
+    get_uint_value("sources", "disks_period_ms", 0, 600000, config.disks_period_ms);
+    get_bool_value("sources", "packets", config.packets_source);
+    std::string psi = get_value("sources", "psi", config.psi_resource);
+    if (psi == "off" || psi == "cpu" || psi == "io" || psi == "memory") {
+        config.psi_resource = psi;
+    } else {
+        os_syslog(LOG_WARNING, "Invalid psi value: %s, using default", psi.c_str());
+    }
+    get_uint_value("sources", "psi_period_ms", 0, 600000, config.psi_period_ms);
+    config.thermal_zone = get_value("sources", "thermal", config.thermal_zone);
+    get_uint_value("sources", "thermal_period_ms", 0, 600000, config.thermal_period_ms);
+    
+    // Parse alert settings
+    get_uint_value("alerts", "drop_rate", 0, UINT32_MAX, config.alert_drop_rate);
+    get_uint_value("alerts", "error_rate", 0, UINT32_MAX, config.alert_error_rate);
+    config.alert_led = get_value("alerts", "led", config.alert_led);
+    get_color_value("alerts", "color", config.alert_color);
+    get_uint_value("alerts", "blink_on_ms", 1, 32767, config.alert_blink_on_ms);
+    get_uint_value("alerts", "blink_off_ms", 1, 32767, config.alert_blink_off_ms);
+    get_uint_value("alerts", "hold_ms", 0, 3600000, config.alert_hold_ms);
+    get_bool_value("alerts", "link_down", config.alert_link_down);
+    
+    // Parse notification settings
+    config.notifications_path = get_value("notifications", "path", config.notifications_path);
+    
+    // Parse polling settings
+    get_uint_value("polling", "interval_ms", 100, 60000, config.interval_ms);
+    get_uint_value("polling", "max_interval_ms", 100, 600000, config.max_interval_ms);
+    if (config.max_interval_ms < config.interval_ms) {
+        os_syslog(LOG_WARNING, "max_interval_ms (%u) is lower than interval_ms (%u), adaptive polling disabled",
+                  config.max_interval_ms, config.interval_ms);
+        config.max_interval_ms = config.interval_ms;
+    }
+    
+    // Peak-hold needs a steady, fast sample rate to catch short bursts
+    if (config.peak_enabled) {
+        config.interval_ms = config.max_interval_ms = config.peak_sample_ms;
+    }
+    
+    uint32_t trigger = config.trigger_percentage;
+    get_uint_value("polling", "trigger_percentage", 0, 100, trigger);
+    config.trigger_percentage = static_cast<uint8_t>(trigger);
+    
+    get_bool_value("polling", "link_events", config.link_events);
+    
+    // Parse history settings
+    get_bool_value("history", "enabled", config.history_enabled);
+    config.history_path = get_value("history", "path", config.history_path);
+    get_uint_value("history", "sync_interval_s", 0, 86400, config.history_sync_interval_s);
+    
+    // Parse traffic totals settings
+    get_bool_value("totals", "enabled", config.totals_enabled);
+    config.totals_directory = get_value("totals", "directory", config.totals_directory);
+    get_uint_value("totals", "flush_interval_s", 0, 86400, config.totals_flush_interval_s);
+    
     // Parse logging settings
     std::string log_level = get_value("logging", "level", config.log_level);
     if (!log_level.empty()) {
@@ -115,17 +224,18 @@ bool config_parser_t::load_config_from_file(const std::string& filename, ledctl_
 }
 
 bool config_parser_t::parse_file(const std::string& filename) {
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+    FILE* file = fopen(filename.c_str(), "re");
+    if (!file) {
         return false;
     }
     
     _config_data.clear();
-    std::string line;
+    char* buf = nullptr;
+    size_t buf_size = 0;
     std::string current_section;
     
-    while (std::getline(file, line)) {
-        line = trim(line);
+    while (getline(&buf, &buf_size, file) >= 0) {
+        std::string line = trim(buf);
         
         // Skip empty lines and comments
         if (line.empty() || line[0] == '#' || line[0] == ';') {
@@ -156,6 +266,8 @@ bool config_parser_t::parse_file(const std::string& filename) {
             _config_data[full_key] = value;
         }
     }
+    free(buf);
+    fclose(file);
     
     return true;
 }
@@ -179,24 +291,228 @@ std::string config_parser_t::get_value(const std::string& section, const std::st
     return default_value;
 }
 
-bool config_parser_t::create_example_config(const std::string& filename) {
-    std::ofstream file(filename);
-    if (!file.is_open()) {
+void config_parser_t::get_uint_value(const std::string& section, const std::string& key,
+                                     uint32_t min_value, uint32_t max_value, uint32_t& value) {
+    std::string str = get_value(section, key);
+    if (str.empty()) {
+        return;
+    }
+    
+    long long parsed = 0;
+    const char* end = str.data() + str.size();
+    auto result = std::from_chars(str.data(), end, parsed);
+    if (result.ec != std::errc() || result.ptr != end) {
+        os_syslog(LOG_WARNING, "Invalid %s value: %s, using default", key.c_str(), str.c_str());
+    } else if (parsed >= min_value && parsed <= max_value) {
+        value = static_cast<uint32_t>(parsed);
+    } else {
+        os_syslog(LOG_WARNING, "%s value out of range (%u-%u): %lld, using default",
+                  key.c_str(), min_value, max_value, parsed);
+    }
+}
+
+void config_parser_t::get_threshold_value(const std::string& section, const std::string& key, uint8_t& value) {
+    uint32_t threshold = value;
+    get_uint_value(section, key, 0, 100, threshold);
+    value = static_cast<uint8_t>(threshold);
+}
+
+void config_parser_t::get_color_value(const std::string& section, const std::string& key, rgb_color_t& value) {
+    std::string str = get_value(section, key);
+    if (str.empty()) {
+        return;
+    }
+    
+    // "r,g,b" with components 0-255
+    unsigned int r, g, b;
+    char extra;
+    if (sscanf(str.c_str(), "%u , %u , %u %c", &r, &g, &b, &extra) == 3 && r <= 255 && g <= 255 && b <= 255) {
+        value = {static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b)};
+    } else {
+        os_syslog(LOG_WARNING, "Invalid %s value: %s (expected r,g,b), using default", key.c_str(), str.c_str());
+    }
+}
+
+std::vector<std::string> config_parser_t::get_section_names(const std::string& prefix) {
+    std::vector<std::string> names;
+    for (const auto& entry : _config_data) {
+        const std::string& key = entry.first;
+        size_t dot = key.rfind('.');
+        if (key.compare(0, prefix.length(), prefix) != 0 || dot < prefix.length()) {
+            continue;
+        }
+        std::string name = key.substr(prefix.length(), dot - prefix.length());
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            names.push_back(name);
+        }
+    }
+    return names;
+}
+
+bool config_parser_t::parse_level(const std::string& name, uint8_t brightness, led_level_t& level) {
+    std::string section = "level." + name;
+    
+    level.name = name;
+    level.leds = 0;
+    level.color = COLOR_WHITE;
+    level.effect = led_effect_t::steady;
+    level.brightness = brightness;
+    
+    if (get_value(section, "threshold").empty()) {
+        os_syslog(LOG_WARNING, "Level %s has no threshold, ignoring it", name.c_str());
+        return false;
+    }
+    uint32_t threshold = 101;
+    get_uint_value(section, "threshold", 0, 100, threshold);
+    if (threshold > 100) {
         return false;
     }
+    level.threshold = static_cast<uint8_t>(threshold);
     
-    file << "[network]\n";
-    file << "interface = eth0\n";
-    file << "capacity_mbps = 2000\n\n";
+    // Comma-separated LED names, "none" for a level with all LEDs off
+    for (const std::string& led : get_list_value(section, "leds", "none")) {
+        led_controller_t::led_type_t id;
+        if (led == "none") {
+            continue;
+        } else if (led_controller_t::parse_led_name(led, id)) {
+            level.leds |= 1u << (size_t)id;
+        } else {
+            os_syslog(LOG_WARNING, "Unknown LED %s in level %s", led.c_str(), name.c_str());
+        }
+    }
+    
+    get_color_value(section, "color", level.color);
     
-    file << "[leds]\n";
-    file << "brightness = 255\n";
-    file << "low_threshold = 10\n";
-    file << "medium_threshold = 40\n";
-    file << "high_threshold = 80\n\n";
+    std::string mode = get_value(section, "mode", "on");
+    if (mode == "blink") {
+        level.effect = led_effect_t::blink;
+    } else if (mode == "breath") {
+        level.effect = led_effect_t::breath;
+    } else if (mode != "on") {
+        os_syslog(LOG_WARNING, "Invalid mode %s in level %s, using on", mode.c_str(), name.c_str());
+    }
     
-    file << "[logging]\n";
-    file << "level = info\n";
+    uint32_t value = brightness;
+    get_uint_value(section, "brightness", 0, 255, value);
+    level.brightness = static_cast<uint8_t>(value);
+    
+    uint32_t t_on = 500, t_off = 500;
+    get_uint_value(section, "on_ms", 1, 32767, t_on);
+    get_uint_value(section, "off_ms", 1, 32767, t_off);
+    level.t_on = static_cast<uint16_t>(t_on);
+    level.t_off = static_cast<uint16_t>(t_off);
     
     return true;
+}
+
+void config_parser_t::get_bool_value(const std::string& section, const std::string& key, bool& value) {
+    std::string str = get_value(section, key);
+    if (str.empty()) {
+        return;
+    }
+    
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    if (str == "true" || str == "yes" || str == "on" || str == "1") {
+        value = true;
+    } else if (str == "false" || str == "no" || str == "off" || str == "0") {
+        value = false;
+    } else {
+        os_syslog(LOG_WARNING, "Invalid %s value: %s, using default", key.c_str(), str.c_str());
+    }
+}
+
+std::vector<std::string> config_parser_t::get_list_value(const std::string& section, const std::string& key,
+                                                         const std::string& default_value) {
+    std::string str = get_value(section, key, default_value);
+    std::vector<std::string> items;
+    for (size_t start = 0, comma; start < str.size(); start = comma + 1) {
+        comma = std::min(str.find(',', start), str.size());
+        std::string item = trim(str.substr(start, comma - start));
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool config_parser_t::create_example_config(const std::string& filename) {
+    FILE* file = fopen(filename.c_str(), "we");
+    if (!file) {
+        return false;
+    }
+    
+    fputs("[network]\n", file);
+    fputs("interface = eth0\n", file);
+    fputs("capacity_mbps = auto\n", file);
+    fputs("counters = auto\n\n", file);
+    
+    fputs("[leds]\n", file);
+    fputs("brightness = 255\n", file);
+    fputs("low_threshold = 10\n", file);
+    fputs("medium_threshold = 40\n", file);
+    fputs("high_threshold = 80\n", file);
+    fputs("i2c_bus = auto\n", file);
+    fputs("i2c_address = 0x3a\n", file);
+    fputs("i2c_adapters = SMBus I801 adapter*\n", file);
+    fputs("i2c_cache = /run/ugreen_leds_ethutild/adapter\n", file);
+    fputs("i2c_lock = /run/lock/ugreen-leds.lock\n", file);
+    fputs("i2c_lock_timeout_ms = 500\n", file);
+    fputs("yield_lease = off\n", file);
+    fputs("readback_bytes_per_s = 4\n\n", file);
+    
+    fputs("# Custom levels replace the thresholds above\n", file);
+    fputs("# [level.busy]\n", file);
+    fputs("# threshold = 30\n", file);
+    fputs("# leds = netdev\n", file);
+    fputs("# color = 255,160,0\n", file);
+    fputs("# mode = on\n\n", file);
+    
+    fputs("[peak]\n", file);
+    fputs("enabled = false\n", file);
+    fputs("sample_ms = 100\n", file);
+    fputs("hold_ms = 1000\n", file);
+    fputs("decay_percentage = 50\n\n", file);
+    
+    fputs("[disks]\n", file);
+    fputs("enabled = false\n", file);
+    fputs("capacity_mbs = 250\n", file);
+    fputs("ports = ata1,ata2\n\n", file);
+    
+    fputs("[sources]\n", file);
+    fputs("network_period_ms = 0\n", file);
+    fputs("disks_period_ms = 0\n", file);
+    fputs("packets = false\n", file);
+    fputs("psi = off\n", file);
+    fputs("thermal = off\n\n", file);
+    
+    fputs("[alerts]\n", file);
+    fputs("drop_rate = 0\n", file);
+    fputs("error_rate = 0\n", file);
+    fputs("led = power\n", file);
+    fputs("color = 255,0,0\n", file);
+    fputs("link_down = false\n\n", file);
+    
+    fputs("[notifications]\n", file);
+    fputs("path = /run/ugreen_leds_ethutild.notify\n\n", file);
+    
+    fputs("[polling]\n", file);
+    fputs("interval_ms = 1000\n", file);
+    fputs("max_interval_ms = 8000\n", file);
+    fputs("trigger_percentage = 5\n", file);
+    fputs("link_events = true\n\n", file);
+    
+    fputs("[history]\n", file);
+    fputs("enabled = false\n", file);
+    fputs("path = /var/lib/ugreen_leds_ethutild/history.rrd\n", file);
+    fputs("sync_interval_s = 600\n\n", file);
+    
+    fputs("[totals]\n", file);
+    fputs("enabled = false\n", file);
+    fputs("directory = /var/lib/ugreen_leds_ethutild\n", file);
+    fputs("flush_interval_s = 300\n\n", file);
+    
+    fputs("[logging]\n", file);
+    fputs("level = info\n", file);
+    
+    return fclose(file) == 0;
 }
\ No newline at end of file
@@ -3,11 +3,15 @@
 
 #include <string>
 #include <map>
+#include <vector>
+
+#include "level_table.h"
 
 struct ledctl_config_t {
     // Network settings
     std::string interface;
-    uint32_t capacity_mbps;
+    uint32_t capacity_mbps;        // 0 = detect from link speed and duplex
+    std::string counters;          // counter backend: "auto", "procfs" or "netlink"
     
     // LED settings
     uint8_t brightness;
@@ -15,17 +19,135 @@ struct ledctl_config_t {
     uint8_t medium_threshold;
     uint8_t high_threshold;
     
+    // Custom [level.<name>] sections, empty = built-in off/low/medium/high table
+    std::vector<led_level_t> levels;
+    
+    // I2C bus, address and adapter discovery of the LED MCU
+    led_bus_t led_bus;
+    std::string yield_lease;       // lease file of LEDs left to other tools, empty = off
+    uint32_t readback_bytes_per_s; // bus budget for reading LEDs back and repairing them, 0 = off
+    
+    // Display settings
+    std::string display_mode;      // "combined" or "per_direction"
+    std::string rx_led;            // LED showing RX in per_direction mode
+    std::string tx_led;            // LED showing TX in per_direction mode
+    uint32_t rx_capacity_mbps;     // 0 = link speed
+    uint32_t tx_capacity_mbps;     // 0 = link speed
+    uint8_t rx_low_threshold;
+    uint8_t rx_medium_threshold;
+    uint8_t rx_high_threshold;
+    uint8_t tx_low_threshold;
+    uint8_t tx_medium_threshold;
+    uint8_t tx_high_threshold;
+    
+    // Peak-hold display
+    bool peak_enabled;
+    uint32_t peak_sample_ms;       // sampling interval while peak-hold is on
+    uint32_t peak_hold_ms;         // how long a peak is shown before it decays
+    uint32_t peak_decay_percentage; // decay rate, percent of capacity per second
+    uint32_t peak_min_update_ms;   // minimum time between LED state changes
+    
+    // Disk settings
+    bool disks_enabled;            // drive disk LEDs from /proc/diskstats
+    uint32_t disk_capacity_mbs;    // per-disk throughput (read + write) treated as 100%
+    std::string disk_ports;        // sysfs path component of each bay, e.g. "ata1,ata2"
+    
+    // Metric sources (period 0 = every tick)
+    uint32_t network_period_ms;
+    uint32_t disks_period_ms;
+    bool packets_source;           // sample packets per second
+    std::string psi_resource;      // "cpu", "io", "memory" or "off"
+    uint32_t psi_period_ms;
+    std::string thermal_zone;      // e.g. "thermal_zone0" or "off"
+    uint32_t thermal_period_ms;
+    
+    // Alert settings (rates are per second, RX + TX, 0 = disabled)
+    uint32_t alert_drop_rate;
+    uint32_t alert_error_rate;     // errors + FIFO overruns
+    std::string alert_led;
+    rgb_color_t alert_color;
+    uint32_t alert_blink_on_ms;
+    uint32_t alert_blink_off_ms;
+    uint32_t alert_hold_ms;        // how long the alert outlives the last exceeding sample
+    bool alert_link_down;          // blink netdev red while the link is down
+    
+    // Notifications, loaded on SIGUSR2
+    std::string notifications_path;
+    
+    // Polling settings
+    uint32_t interval_ms;          // fastest sampling interval
+    uint32_t max_interval_ms;      // slowest sampling interval while idle
+    uint8_t trigger_percentage;    // usage delta that snaps back to fast sampling, 0 = off
+    bool link_events;              // wake up early on netlink link events
+    
+    // History archive
+    bool history_enabled;
+    std::string history_path;
+    uint32_t history_sync_interval_s; // explicit flush interval, 0 = only at exit
+    
+    // Daily/monthly traffic totals
+    bool totals_enabled;
+    std::string totals_directory;
+    uint32_t totals_flush_interval_s; // at most this much traffic is lost on a crash
+    
     // Logging settings
     std::string log_level;
     
     // Default values
     ledctl_config_t()
         : interface("eth0")
-        , capacity_mbps(2000)  // 1Gbps full duplex
+        , capacity_mbps(0)  // auto
+        , counters("auto")
         , brightness(255)
         , low_threshold(10)
         , medium_threshold(40)
         , high_threshold(80)
+        , readback_bytes_per_s(4)
+        , display_mode("combined")
+        , rx_led("netdev")
+        , tx_led("disk1")
+        , rx_capacity_mbps(0)
+        , tx_capacity_mbps(0)
+        , rx_low_threshold(10)
+        , rx_medium_threshold(40)
+        , rx_high_threshold(80)
+        , tx_low_threshold(10)
+        , tx_medium_threshold(40)
+        , tx_high_threshold(80)
+        , peak_enabled(false)
+        , peak_sample_ms(100)
+        , peak_hold_ms(1000)
+        , peak_decay_percentage(50)
+        , peak_min_update_ms(250)
+        , disks_enabled(false)
+        , disk_capacity_mbs(250)
+        , disk_ports("ata1,ata2")
+        , network_period_ms(0)
+        , disks_period_ms(0)
+        , packets_source(false)
+        , psi_resource("off")
+        , psi_period_ms(10000)
+        , thermal_zone("off")
+        , thermal_period_ms(10000)
+        , alert_drop_rate(0)
+        , alert_error_rate(0)
+        , alert_led("power")
+        , alert_color(COLOR_RED)
+        , alert_blink_on_ms(250)
+        , alert_blink_off_ms(250)
+        , alert_hold_ms(10000)
+        , alert_link_down(false)
+        , notifications_path("/run/ugreen_leds_ethutild.notify")
+        , interval_ms(1000)
+        , max_interval_ms(8000)
+        , trigger_percentage(5)
+        , link_events(true)
+        , history_enabled(false)
+        , history_path("/var/lib/ugreen_leds_ethutild/history.rrd")
+        , history_sync_interval_s(600)
+        , totals_enabled(false)
+        , totals_directory("/var/lib/ugreen_leds_ethutild")
+        , totals_flush_interval_s(300)
         , log_level("info")
     {}
 };
@@ -38,6 +160,20 @@ private:
     std::string trim(const std::string& str);
     std::string get_value(const std::string& section, const std::string& key, const std::string& default_value = "");
     
+    // Typed helpers, leave the value untouched (and log a warning) if the key is invalid
+    void get_uint_value(const std::string& section, const std::string& key, uint32_t min_value, uint32_t max_value, uint32_t& value);
+    void get_bool_value(const std::string& section, const std::string& key, bool& value);
+    void get_threshold_value(const std::string& section, const std::string& key, uint8_t& value);
+    void get_color_value(const std::string& section, const std::string& key, rgb_color_t& value);
+    
+    // Comma separated items, trimmed, empty ones dropped
+    std::vector<std::string> get_list_value(const std::string& section, const std::string& key,
+                                            const std::string& default_value = "");
+    
+    // Names of all sections starting with prefix, e.g. "level." -> {"idle", "busy"}
+    std::vector<std::string> get_section_names(const std::string& prefix);
+    bool parse_level(const std::string& name, uint8_t brightness, led_level_t& level);
+    
 public:
     // Load configuration from file
     // Tries ./ugreen_leds_ethutild.conf first, then /etc/ugreen_leds_ethutild.conf
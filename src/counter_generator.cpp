@@ -0,0 +1,150 @@
+#include "counter_generator.h"
+#include "sys_root.h"
+#include "os.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+// Average frame size used to derive packet counters from bytes
+#define GENERATOR_PACKET_SIZE 1500
+
+counter_generator_t::counter_generator_t()
+    : _profile_seconds(0.0), _elapsed(0.0), _step(0), _rx_bytes(0), _tx_bytes(0),
+      _rx_packets(0), _tx_packets(0), _rx_fraction(0.0), _tx_fraction(0.0) {
+}
+
+bool counter_generator_t::parse_profile(const std::string& text, std::vector<traffic_step_t>& profile) {
+    profile.clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(',', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        
+        std::string item = text.substr(start, end - start);
+        traffic_step_t step;
+        char extra;
+        if (sscanf(item.c_str(), "%lf:%lf:%lf%c", &step.rx_mbps, &step.tx_mbps, &step.seconds, &extra) != 3 ||
+            step.rx_mbps < 0.0 || step.tx_mbps < 0.0 || step.seconds <= 0.0) {
+            os_syslog(LOG_ERR, "Invalid profile step \"%s\", expected RX:TX:SECONDS", item.c_str());
+            return false;
+        }
+        profile.push_back(step);
+        start = end + 1;
+    }
+    return !profile.empty();
+}
+
+bool counter_generator_t::write_file(const std::string& path, const std::string& content) {
+    // The service keeps its counter files open and re-reads them from the
+    // start, so they are rewritten in place rather than replaced. Counters
+    // only grow, so the new contents cover the old ones completely.
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        os_syslog(LOG_ERR, "Failed to create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    bool written = pwrite(fd, content.data(), content.size(), 0) == (ssize_t)content.size() &&
+                   ftruncate(fd, content.size()) == 0;
+    close(fd);
+    
+    if (!written) {
+        os_syslog(LOG_ERR, "Failed to write %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool counter_generator_t::create(const std::string& root, const std::string& interface, uint32_t speed_mbps,
+                                 const std::vector<traffic_step_t>& profile) {
+    _root = root;
+    _interface = interface;
+    _profile = profile;
+    _profile_seconds = 0.0;
+    for (const traffic_step_t& step : _profile) {
+        _profile_seconds += step.seconds;
+    }
+    
+    std::string net = root + "/sys/class/net/" + interface;
+    std::string adapter = root + "/sys/class/i2c-dev/i2c-0";
+    if (!make_directories(net + "/statistics") || !make_directories(root + "/proc/net") ||
+        !make_directories(adapter + "/device") || !make_directories(root + "/dev") ||
+        !make_directories(root + "/run/lock") || !make_directories(root + "/run/ugreen_leds_ethutild")) {
+        os_syslog(LOG_ERR, "Failed to create the tree below %s: %s", root.c_str(), strerror(errno));
+        return false;
+    }
+    
+    bool created = write_file(net + "/ifindex", "2\n") &&
+                   write_file(net + "/carrier", "1\n") &&
+                   write_file(net + "/carrier_changes", "1\n") &&
+                   write_file(net + "/operstate", "up\n") &&
+                   write_file(net + "/speed", std::to_string(speed_mbps) + "\n") &&
+                   write_file(net + "/duplex", "full\n") &&
+                   write_file(adapter + "/device/name", "SMBus I801 adapter at efa0\n") &&
+                   write_file(root + "/dev/i2c-0", "");
+    
+    for (const char* counter : {"rx_errors", "tx_errors", "rx_dropped", "tx_dropped", "rx_fifo_errors", "tx_fifo_errors"}) {
+        created = created && write_file(net + "/statistics/" + counter, "0\n");
+    }
+    
+    return created && write_counters();
+}
+
+bool counter_generator_t::advance(double seconds) {
+    // Long advances are split at step boundaries so every step gets its own rate
+    while (seconds > 0.0) {
+        double position = _elapsed;
+        size_t step = 0;
+        while (position >= _profile[step].seconds) {
+            position -= _profile[step].seconds;
+            step = (step + 1) % _profile.size();
+        }
+        _step = step;
+        
+        double slice = std::min(seconds, _profile[step].seconds - position);
+        _rx_fraction += _profile[step].rx_mbps * 1000000.0 / 8.0 * slice;
+        _tx_fraction += _profile[step].tx_mbps * 1000000.0 / 8.0 * slice;
+        
+        _elapsed += slice;
+        if (_elapsed >= _profile_seconds) {
+            _elapsed -= _profile_seconds;
+        }
+        seconds -= slice;
+    }
+    
+    uint64_t rx = (uint64_t)_rx_fraction;
+    uint64_t tx = (uint64_t)_tx_fraction;
+    _rx_fraction -= rx;
+    _tx_fraction -= tx;
+    _rx_bytes += rx;
+    _tx_bytes += tx;
+    _rx_packets = _rx_bytes / GENERATOR_PACKET_SIZE;
+    _tx_packets = _tx_bytes / GENERATOR_PACKET_SIZE;
+    
+    return write_counters();
+}
+
+bool counter_generator_t::write_counters() {
+    std::string statistics = _root + "/sys/class/net/" + _interface + "/statistics/";
+    
+    char line[256];
+    snprintf(line, sizeof(line), "%6s: %lu %lu 0 0 0 0 0 0 %lu %lu 0 0 0 0 0 0\n", _interface.c_str(),
+             _rx_bytes, _rx_packets, _tx_bytes, _tx_packets);
+    std::string net_dev =
+        "Inter-|   Receive                                                |  Transmit\n"
+        " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n";
+    net_dev += line;
+    
+    return write_file(statistics + "rx_bytes", std::to_string(_rx_bytes) + "\n") &&
+           write_file(statistics + "tx_bytes", std::to_string(_tx_bytes) + "\n") &&
+           write_file(statistics + "rx_packets", std::to_string(_rx_packets) + "\n") &&
+           write_file(statistics + "tx_packets", std::to_string(_tx_packets) + "\n") &&
+           write_file(_root + "/proc/net/dev", net_dev);
+}
@@ -0,0 +1,51 @@
+#ifndef __LEDCTL_COUNTER_GENERATOR_H__
+#define __LEDCTL_COUNTER_GENERATOR_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// One step of a traffic profile
+struct traffic_step_t {
+    double rx_mbps;
+    double tx_mbps;
+    double seconds;
+};
+
+// Keeps the statistics files of a fake interface below a root directory
+// (see sys_root.h) moving at a programmed traffic profile, so the whole
+// service can be benchmarked and soak-tested without hardware or root.
+class counter_generator_t {
+private:
+    std::string _root;
+    std::string _interface;
+    std::vector<traffic_step_t> _profile;
+    double _profile_seconds;
+    double _elapsed;
+    size_t _step;
+    uint64_t _rx_bytes, _tx_bytes;
+    uint64_t _rx_packets, _tx_packets;
+    double _rx_fraction, _tx_fraction;  // bytes not yet added to the counters
+    
+    bool write_file(const std::string& path, const std::string& content);
+    bool write_counters();
+
+public:
+    counter_generator_t();
+    
+    // "RX:TX:SECONDS[,RX:TX:SECONDS...]" in Mbps, played in a loop
+    static bool parse_profile(const std::string& text, std::vector<traffic_step_t>& profile);
+    
+    // Create the fake tree: the interface with its link attributes,
+    // /proc/net/dev and an I801 adapter whose device node is a plain file
+    bool create(const std::string& root, const std::string& interface, uint32_t speed_mbps,
+                const std::vector<traffic_step_t>& profile);
+    
+    // Let seconds of traffic pass and rewrite the counters
+    bool advance(double seconds);
+    
+    size_t get_step() const { return _step; }
+    const traffic_step_t& get_current() const { return _profile[_step]; }
+};
+
+#endif
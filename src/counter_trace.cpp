@@ -0,0 +1,127 @@
+#include "counter_trace.h"
+#include "os.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <cerrno>
+#include <cstring>
+
+#define TRACE_MAGIC "LEDTRCE"
+#define TRACE_VERSION 1
+
+counter_trace_t::counter_trace_t() : _fd(-1), _capacity_mbps(0), _has_start(false) {
+}
+
+counter_trace_t::~counter_trace_t() {
+    if (_fd >= 0) {
+        os_close(_fd);
+    }
+}
+
+bool counter_trace_t::create(const std::string& path, const std::string& interface, uint32_t capacity_mbps) {
+    _fd = os_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        os_syslog(LOG_ERR, "Failed to create trace %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.version = TRACE_VERSION;
+    header.capacity_mbps = capacity_mbps;
+    strncpy(header.interface, interface.c_str(), sizeof(header.interface) - 1);
+    
+    if (os_write(_fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        os_syslog(LOG_ERR, "Failed to write trace %s: %s", path.c_str(), strerror(errno));
+        os_close(_fd);
+        _fd = -1;
+        return false;
+    }
+    
+    _interface = interface;
+    _capacity_mbps = capacity_mbps;
+    os_syslog(LOG_INFO, "Recording counter trace to %s", path.c_str());
+    return true;
+}
+
+bool counter_trace_t::append(const network_stats_t& stats) {
+    if (_fd < 0) {
+        return false;
+    }
+    
+    if (!_has_start) {
+        _start = stats.timestamp;
+        _has_start = true;
+    }
+    
+    trace_record_t record = {
+        (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(stats.timestamp - _start).count(),
+        stats.rx_bytes, stats.tx_bytes,
+        stats.rx_packets, stats.tx_packets,
+        stats.rx_errors, stats.tx_errors,
+        stats.rx_dropped, stats.tx_dropped,
+        stats.rx_fifo, stats.tx_fifo,
+        stats.carrier_changes,
+        stats.ifindex,
+        stats.has_extended ? TRACE_FLAG_EXTENDED : 0u
+    };
+    
+    // One write per sample, a crash loses at most the record being written
+    if (os_write(_fd, &record, sizeof(record)) != (ssize_t)sizeof(record)) {
+        os_syslog(LOG_WARNING, "Failed to write trace record: %s, recording stopped", strerror(errno));
+        os_close(_fd);
+        _fd = -1;
+        return false;
+    }
+    return true;
+}
+
+bool counter_trace_t::load(const std::string& path) {
+    int fd = os_open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        os_syslog(LOG_ERR, "Failed to open trace %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    header_t header;
+    struct stat st;
+    bool valid = os_read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+                 memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0 &&
+                 header.version == TRACE_VERSION && fstat(fd, &st) == 0;
+    
+    if (valid) {
+        // A trailing partial record (crash while recording) is dropped
+        size_t count = ((size_t)st.st_size - sizeof(header)) / sizeof(trace_record_t);
+        _records.resize(count);
+        ssize_t size = count * sizeof(trace_record_t);
+        valid = os_read(fd, _records.data(), size) == size;
+    }
+    os_close(fd);
+    
+    if (!valid) {
+        os_syslog(LOG_ERR, "%s is not a counter trace of this version", path.c_str());
+        _records.clear();
+        return false;
+    }
+    
+    header.interface[sizeof(header.interface) - 1] = '\0';
+    _interface = header.interface;
+    _capacity_mbps = header.capacity_mbps;
+    return true;
+}
+
+network_stats_t counter_trace_t::to_stats(const trace_record_t& record, std::chrono::steady_clock::time_point base) {
+    return network_stats_t{
+        record.rx_bytes, record.tx_bytes,
+        record.rx_packets, record.tx_packets,
+        record.rx_errors, record.tx_errors,
+        record.rx_dropped, record.tx_dropped,
+        record.rx_fifo, record.tx_fifo,
+        (record.flags & TRACE_FLAG_EXTENDED) != 0,
+        record.ifindex,
+        record.carrier_changes,
+        base + std::chrono::microseconds(record.time_us)
+    };
+}
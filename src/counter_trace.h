@@ -0,0 +1,65 @@
+#ifndef __LEDCTL_COUNTER_TRACE_H__
+#define __LEDCTL_COUNTER_TRACE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "bandwidth_monitor.h"
+
+// One counter sample as stored in a trace file
+struct trace_record_t {
+    uint64_t time_us;           // since the first record
+    uint64_t rx_bytes, tx_bytes;
+    uint64_t rx_packets, tx_packets;
+    uint64_t rx_errors, tx_errors;
+    uint64_t rx_dropped, tx_dropped;
+    uint64_t rx_fifo, tx_fifo;
+    uint64_t carrier_changes;
+    int32_t ifindex;
+    uint32_t flags;             // TRACE_FLAG_*
+};
+
+#define TRACE_FLAG_EXTENDED 0x1
+
+// Binary trace of the raw interface counters, written with --record and fed
+// back through the rate computation with --replay. Records keep everything
+// bandwidth_monitor_t looks at, so a replay takes the same decisions.
+class counter_trace_t {
+private:
+    struct header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t capacity_mbps;
+        char interface[16];
+    };
+    
+    int _fd;
+    std::string _interface;
+    uint32_t _capacity_mbps;
+    bool _has_start;
+    std::chrono::steady_clock::time_point _start;
+    std::vector<trace_record_t> _records;
+
+public:
+    counter_trace_t();
+    ~counter_trace_t();
+    
+    // Start a new trace file
+    bool create(const std::string& path, const std::string& interface, uint32_t capacity_mbps);
+    
+    // Append a sample (recording)
+    bool append(const network_stats_t& stats);
+    
+    // Load a whole trace into memory (replay)
+    bool load(const std::string& path);
+    
+    const std::vector<trace_record_t>& get_records() const { return _records; }
+    const std::string& get_interface() const { return _interface; }
+    uint32_t get_capacity_mbps() const { return _capacity_mbps; }
+    
+    // Turn a record back into a sample, base is the time of the first record
+    static network_stats_t to_stats(const trace_record_t& record, std::chrono::steady_clock::time_point base);
+};
+
+#endif
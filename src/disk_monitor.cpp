@@ -0,0 +1,176 @@
+#include "disk_monitor.h"
+#include "sys_root.h"
+#include "os.h"
+#include <dirent.h>
+#include <syslog.h>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+#define DISKSTATS_PATH  "/proc/diskstats"
+#define SYS_BLOCK_PATH  "/sys/block/"
+
+// /proc/diskstats always counts 512 byte sectors
+#define SECTOR_SIZE     512
+
+disk_monitor_t::disk_monitor_t(const std::string& ports)
+    : _diskstats_file(sys_path(DISKSTATS_PATH)), _sys_block_path(sys_path(SYS_BLOCK_PATH)),
+      _rescan_needed(true) {
+    for (size_t from = 0, comma; from < ports.size(); from = comma + 1) {
+        comma = std::min(ports.find(',', from), ports.size());
+        std::string port = ports.substr(from, comma - from);
+        size_t start = port.find_first_not_of(" \t");
+        size_t end = port.find_last_not_of(" \t");
+        port = (start == std::string::npos) ? "" : port.substr(start, end - start + 1);
+        _bays.push_back({port, "", 0, 0, false, false});
+    }
+    _usage.resize(_bays.size(), {false, 0.0, 0.0});
+    _buffer.resize(16384);
+}
+
+bool disk_monitor_t::initialize() {
+    map_devices();
+    
+    if (!read_diskstats()) {
+        os_syslog(LOG_ERR, "Failed to read %s", _diskstats_file.get_path().c_str());
+        return false;
+    }
+    
+    _last_sample = std::chrono::steady_clock::now();
+    parse_buffer(0.0);
+    
+    return true;
+}
+
+void disk_monitor_t::map_devices() {
+    _rescan_needed = false;
+    for (auto& bay : _bays) {
+        bay.device.clear();
+        bay.has_last = false;
+    }
+    
+    DIR* dir = opendir(_sys_block_path.c_str());
+    if (!dir) {
+        os_syslog(LOG_WARNING, "Cannot open %s, disk LEDs disabled", _sys_block_path.c_str());
+        return;
+    }
+    
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        
+        // /sys/block/sda -> /sys/devices/pci0000:00/0000:00:17.0/ata1/host0/.../block/sda
+        std::string link = _sys_block_path + entry->d_name;
+        char resolved[PATH_MAX];
+        if (!realpath(link.c_str(), resolved)) {
+            continue;
+        }
+        
+        std::string path = std::string(resolved) + "/";
+        for (auto& bay : _bays) {
+            if (!bay.port.empty() && bay.device.empty() && path.find("/" + bay.port + "/") != std::string::npos) {
+                bay.device = entry->d_name;
+                os_syslog(LOG_INFO, "Disk bay %s: %s", bay.port.c_str(), bay.device.c_str());
+                break;
+            }
+        }
+    }
+    
+    closedir(dir);
+    
+    for (size_t i = 0; i < _bays.size(); ++i) {
+        _usage[i] = {!_bays[i].device.empty(), 0.0, 0.0};
+        if (_bays[i].device.empty()) {
+            os_syslog(LOG_INFO, "Disk bay %s: empty", _bays[i].port.c_str());
+        }
+    }
+}
+
+bool disk_monitor_t::read_diskstats() {
+    return _diskstats_file.read(_buffer);
+}
+
+bool disk_monitor_t::read() {
+    if (_rescan_needed) {
+        map_devices();
+    }
+    
+    if (!read_diskstats()) {
+        return false;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration_cast<std::chrono::milliseconds>(now - _last_sample).count() / 1000.0;
+    _last_sample = now;
+    
+    for (auto& bay : _bays) {
+        bay.seen = false;
+    }
+    
+    parse_buffer(seconds);
+    
+    for (size_t i = 0; i < _bays.size(); ++i) {
+        bay_t& bay = _bays[i];
+        if (!bay.device.empty() && !bay.seen) {
+            // Disk was removed, look for a replacement on the next sample
+            os_syslog(LOG_INFO, "Disk %s disappeared from bay %s", bay.device.c_str(), bay.port.c_str());
+            _usage[i] = {false, 0.0, 0.0};
+            _rescan_needed = true;
+        }
+    }
+    
+    return true;
+}
+
+void disk_monitor_t::parse_buffer(double seconds) {
+    // Single pass over the file, only lines of mapped devices are parsed further
+    const char* line = _buffer.data();
+    const char* end = line + strlen(line);
+    while (line < end) {
+        const char* eol = (const char*)memchr(line, '\n', end - line);
+        if (!eol) eol = end;
+        parse_line(line, eol, seconds);
+        line = eol + 1;
+    }
+}
+
+void disk_monitor_t::parse_line(const char* line, const char* end, double seconds) {
+    // Format: major minor name reads merged sectors_read ms_reading writes merged sectors_written ...
+    char* pos;
+    strtoul(line, &pos, 10);
+    strtoul(pos, &pos, 10);
+    while (pos < end && *pos == ' ') ++pos;
+    
+    const char* name = pos;
+    while (pos < end && *pos != ' ') ++pos;
+    size_t name_len = pos - name;
+    
+    for (size_t i = 0; i < _bays.size(); ++i) {
+        bay_t& bay = _bays[i];
+        if (bay.device.size() != name_len || memcmp(bay.device.data(), name, name_len) != 0) {
+            continue;
+        }
+        
+        uint64_t fields[7];
+        for (int f = 0; f < 7; ++f) {
+            fields[f] = strtoull(pos, &pos, 10);
+        }
+        uint64_t read_sectors = fields[2];
+        uint64_t write_sectors = fields[6];
+        
+        if (bay.has_last && seconds > 0.0 && read_sectors >= bay.read_sectors && write_sectors >= bay.write_sectors) {
+            _usage[i].read_mbs = (read_sectors - bay.read_sectors) * (double)SECTOR_SIZE / (seconds * 1000000.0);
+            _usage[i].write_mbs = (write_sectors - bay.write_sectors) * (double)SECTOR_SIZE / (seconds * 1000000.0);
+        }
+        
+        bay.read_sectors = read_sectors;
+        bay.write_sectors = write_sectors;
+        bay.has_last = true;
+        bay.seen = true;
+        _usage[i].present = true;
+        return;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef __LEDCTL_DISK_MONITOR_H__
+#define __LEDCTL_DISK_MONITOR_H__
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "metric_source.h"
+#include "sys_root.h"
+
+struct disk_usage_t {
+    bool present;       // a block device is mapped to the bay
+    double read_mbs;
+    double write_mbs;
+};
+
+// Per-bay disk throughput from /proc/diskstats. Bays are identified by a
+// component of the device's sysfs path, e.g. the ATA port "ata1".
+class disk_monitor_t : public metric_input_t {
+private:
+    struct bay_t {
+        std::string port;           // sysfs path component identifying the bay
+        std::string device;         // block device name, empty if the bay is empty
+        uint64_t read_sectors;
+        uint64_t write_sectors;
+        bool has_last;
+        bool seen;
+    };
+    
+    std::vector<bay_t> _bays;
+    std::vector<disk_usage_t> _usage;
+    std::vector<char> _buffer;      // reused between samples
+    sys_file_t _diskstats_file;
+    std::string _sys_block_path;
+    std::chrono::steady_clock::time_point _last_sample;
+    bool _rescan_needed;
+    
+    void map_devices();
+    bool read_diskstats();
+    void parse_buffer(double seconds);
+    void parse_line(const char* line, const char* end, double seconds);
+
+protected:
+    // Take a new measurement, returns false if /proc/diskstats cannot be read
+    bool read() override;
+
+public:
+    // ports: comma separated list, one entry per bay (disk1, disk2, ...)
+    explicit disk_monitor_t(const std::string& ports);
+    
+    // Map block devices to bays and take the first measurement
+    bool initialize();
+    
+    // Usage per bay, index 0 is disk1
+    const std::vector<disk_usage_t>& get_usage() const { return _usage; }
+};
+
+#endif
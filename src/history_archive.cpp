@@ -0,0 +1,231 @@
+#include "history_archive.h"
+#include "os.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#define HISTORY_MAGIC "LEDHIST"
+#define HISTORY_VERSION 1
+#define HISTORY_DATA_OFFSET 4096
+
+// Longest gap between two samples that is still filled in, anything longer
+// (suspend, clock step) starts over from a one second sample
+#define HISTORY_MAX_GAP_S 60.0
+
+const history_resolution_t history_archive_t::RESOLUTIONS[ARCHIVE_COUNT] = {
+    {"1s", 1, 3600},        // 1 hour
+    {"1m", 60, 1440},       // 1 day
+    {"1h", 3600, 8760}      // 1 year
+};
+
+history_archive_t::history_archive_t()
+    : _fd(-1), _map(nullptr), _size(0), _writable(false), _last_time(0.0), _sync_interval_s(0) {
+}
+
+history_archive_t::~history_archive_t() {
+    close();
+}
+
+void history_archive_t::build_header(header_t& header, size_t& size) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+    header.version = HISTORY_VERSION;
+    header.archive_count = ARCHIVE_COUNT;
+    
+    size = HISTORY_DATA_OFFSET;
+    for (size_t i = 0; i < ARCHIVE_COUNT; ++i) {
+        header.archives[i].step_s = RESOLUTIONS[i].step_s;
+        header.archives[i].rows = RESOLUTIONS[i].rows;
+        header.archives[i].offset = size;
+        size += (size_t)RESOLUTIONS[i].rows * sizeof(history_row_t);
+    }
+}
+
+bool history_archive_t::open(const std::string& path, uint32_t sync_interval_s) {
+    _sync_interval_s = sync_interval_s;
+    _last_sync = std::chrono::steady_clock::now();
+    return map(path, true);
+}
+
+bool history_archive_t::open_readonly(const std::string& path) {
+    return map(path, false);
+}
+
+bool history_archive_t::map(const std::string& path, bool writable) {
+    close();
+    
+    header_t expected;
+    size_t size;
+    build_header(expected, size);
+    
+    // The directory normally comes from systemd's StateDirectory=
+    size_t slash = path.rfind('/');
+    if (writable && slash != std::string::npos && slash > 0) {
+        mkdir(path.substr(0, slash).c_str(), 0755);
+    }
+    
+    _fd = os_open(path.c_str(), writable ? (O_RDWR | O_CREAT | O_CLOEXEC) : (O_RDONLY | O_CLOEXEC), 0644);
+    if (_fd < 0) {
+        os_syslog(writable ? LOG_ERR : LOG_WARNING, "Failed to open history archive %s: %s",
+                  path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    struct stat st;
+    header_t header;
+    bool valid = fstat(_fd, &st) == 0 && (size_t)st.st_size == size &&
+                 os_pread(_fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+                 memcmp(&header, &expected, sizeof(header)) == 0;
+    
+    if (!valid) {
+        if (!writable) {
+            os_syslog(LOG_ERR, "%s is not a history archive of this version", path.c_str());
+            close();
+            return false;
+        }
+        
+        // New file or a different layout, start from an empty archive
+        os_syslog(LOG_INFO, "Creating history archive %s (%zu KiB)", path.c_str(), size / 1024);
+        if (ftruncate(_fd, 0) != 0 || ftruncate(_fd, size) != 0 ||
+            os_pwrite(_fd, &expected, sizeof(expected), 0) != (ssize_t)sizeof(expected)) {
+            os_syslog(LOG_ERR, "Failed to create history archive %s: %s", path.c_str(), strerror(errno));
+            close();
+            return false;
+        }
+    }
+    
+    void* map = mmap(nullptr, size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED) {
+        os_syslog(LOG_ERR, "Failed to map history archive %s: %s", path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+    
+    _map = (uint8_t*)map;
+    _size = size;
+    _writable = writable;
+    return true;
+}
+
+void history_archive_t::close() {
+    if (_map) {
+        if (_writable) {
+            os_msync(_map, _size, MS_SYNC);
+        }
+        munmap(_map, _size);
+        _map = nullptr;
+    }
+    if (_fd >= 0) {
+        os_close(_fd);
+        _fd = -1;
+    }
+}
+
+history_row_t* history_archive_t::get_archive(size_t archive) const {
+    const header_t* header = (const header_t*)_map;
+    return (history_row_t*)(_map + header->archives[archive].offset);
+}
+
+void history_archive_t::add(double now, double rx_mbps, double tx_mbps) {
+    if (!_map || !_writable) {
+        return;
+    }
+    
+    double start = now - 1.0;
+    if (_last_time > 0.0 && now > _last_time && now - _last_time <= HISTORY_MAX_GAP_S) {
+        start = _last_time;
+    }
+    _last_time = now;
+    
+    for (size_t i = 0; i < ARCHIVE_COUNT; ++i) {
+        add_to(i, start, now, rx_mbps, tx_mbps);
+    }
+    
+    sync();
+}
+
+void history_archive_t::add_to(size_t archive, double start, double end, double rx_mbps, double tx_mbps) {
+    uint32_t step = RESOLUTIONS[archive].step_s;
+    uint32_t count = RESOLUTIONS[archive].rows;
+    history_row_t* rows = get_archive(archive);
+    
+    // At most HISTORY_MAX_GAP_S / step + 2 slots
+    uint64_t first = (uint64_t)(start / step);
+    uint64_t last = (uint64_t)std::ceil(end / step) - 1;
+    
+    for (uint64_t slot = first; slot <= last; ++slot) {
+        double from = std::max(start, (double)(slot * step));
+        double to = std::min(end, (double)((slot + 1) * step));
+        if (to <= from) {
+            continue;
+        }
+        
+        history_row_t& row = rows[slot % count];
+        uint32_t time = (uint32_t)(slot * step);
+        if (row.time != time) {
+            row = history_row_t{time, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+        }
+        
+        float seconds = row.seconds + (float)(to - from);
+        float weight = (float)(to - from) / seconds;
+        row.rx_mean += ((float)rx_mbps - row.rx_mean) * weight;
+        row.tx_mean += ((float)tx_mbps - row.tx_mean) * weight;
+        row.rx_peak = std::max(row.rx_peak, (float)rx_mbps);
+        row.tx_peak = std::max(row.tx_peak, (float)tx_mbps);
+        row.seconds = seconds;
+    }
+}
+
+void history_archive_t::sync(bool force) {
+    if (!_map || !_writable) {
+        return;
+    }
+    
+    // Between syncs the kernel writes dirty pages back on its own schedule
+    // (vm.dirty_expire_centisecs), this only bounds how much can be lost
+    auto now = std::chrono::steady_clock::now();
+    if (!force && (_sync_interval_s == 0 || now - _last_sync < std::chrono::seconds(_sync_interval_s))) {
+        return;
+    }
+    
+    if (os_msync(_map, _size, MS_SYNC) != 0) {
+        os_syslog(LOG_WARNING, "Failed to sync history archive: %s", strerror(errno));
+    }
+    _last_sync = now;
+}
+
+void history_archive_t::get_rows(size_t archive, double now, std::vector<history_row_t>& rows) const {
+    rows.clear();
+    if (!_map || archive >= ARCHIVE_COUNT) {
+        return;
+    }
+    
+    uint32_t step = RESOLUTIONS[archive].step_s;
+    uint32_t count = RESOLUTIONS[archive].rows;
+    const history_row_t* archive_rows = get_archive(archive);
+    
+    uint64_t current = (uint64_t)(now / step);
+    uint64_t first = current >= count ? current - count + 1 : 0;
+    
+    for (uint64_t slot = first; slot <= current; ++slot) {
+        const history_row_t& row = archive_rows[slot % count];
+        if (row.time == (uint32_t)(slot * step) && row.seconds > 0.0f) {
+            rows.push_back(row);
+        }
+    }
+}
+
+int history_archive_t::find_resolution(const std::string& name) {
+    for (size_t i = 0; i < ARCHIVE_COUNT; ++i) {
+        if (name == RESOLUTIONS[i].name) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,84 @@
+#ifndef __LEDCTL_HISTORY_ARCHIVE_H__
+#define __LEDCTL_HISTORY_ARCHIVE_H__
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Consolidated bandwidth over one step of an archive
+struct history_row_t {
+    uint32_t time;          // start of the step (unix seconds), identifies the slot
+    float seconds;          // how much of the step is covered by samples
+    float rx_mean, tx_mean; // Mbps, time-weighted
+    float rx_peak, tx_peak; // Mbps, highest sample
+};
+
+struct history_resolution_t {
+    const char* name;
+    uint32_t step_s;
+    uint32_t rows;
+};
+
+// Fixed-size round-robin archive (like an RRD) in an mmap'd file. Every
+// resolution is a ring indexed by (time / step) % rows, so a sample only
+// touches the rows it covers and no head pointer has to be kept; a row whose
+// time does not match its slot is stale and ignored by readers.
+class history_archive_t {
+public:
+    static const size_t ARCHIVE_COUNT = 3;
+    static const history_resolution_t RESOLUTIONS[ARCHIVE_COUNT];
+
+private:
+    struct archive_info_t {
+        uint32_t step_s;
+        uint32_t rows;
+        uint64_t offset;            // of the first row, from the start of the file
+    };
+    
+    struct header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t archive_count;
+        archive_info_t archives[ARCHIVE_COUNT];
+    };
+    
+    int _fd;
+    uint8_t* _map;
+    size_t _size;
+    bool _writable;
+    double _last_time;
+    uint32_t _sync_interval_s;
+    std::chrono::steady_clock::time_point _last_sync;
+    
+    static void build_header(header_t& header, size_t& size);
+    bool map(const std::string& path, bool writable);
+    history_row_t* get_archive(size_t archive) const;
+    void add_to(size_t archive, double start, double end, double rx_mbps, double tx_mbps);
+
+public:
+    history_archive_t();
+    ~history_archive_t();
+    
+    // Open (and create or reset if the layout differs) for writing
+    bool open(const std::string& path, uint32_t sync_interval_s);
+    
+    // Open an existing archive for queries
+    bool open_readonly(const std::string& path);
+    
+    void close();
+    
+    // Add a sample taken at now (unix seconds) covering the time since the previous one
+    void add(double now, double rx_mbps, double tx_mbps);
+    
+    // Flush to disk if sync_interval_s has passed (or always with force)
+    void sync(bool force = false);
+    
+    // Rows of an archive inside its window ending at now, oldest first
+    void get_rows(size_t archive, double now, std::vector<history_row_t>& rows) const;
+    
+    // Archive index for "1s", "1m" or "1h", -1 if unknown
+    static int find_resolution(const std::string& name);
+};
+
+#endif
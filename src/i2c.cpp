@@ -1,99 +1,156 @@
 #include <linux/i2c-dev.h>
 #include <linux/i2c.h>
-#include <sys/ioctl.h>
-
-#include <unistd.h>
 #include <fcntl.h>
+#include <cerrno>
 
 #include "i2c.h"
+#include "os.h"
+
+// Standard mode SMBus: 10 us per bit, 9 bits per byte with the ACK
+#define I2C_MOCK_NS_PER_BYTE 90000
 
 
 i2c_device_t::~i2c_device_t() {
-    if (_fd) close(_fd);
+    if (_fd) os_close(_fd);
 }
 
 int i2c_device_t::start(const char *filename, uint16_t addr) {
-    _fd = open(filename, O_RDWR);
-
+    _fd = os_open(filename, O_RDWR);
+    
     if (_fd < 0) {
         int rc = _fd;
         _fd = 0;
         return rc;
     }
-
-    int rc = ioctl(_fd, I2C_SLAVE, addr);
+    
+    int rc = os_ioctl(_fd, I2C_SLAVE, (unsigned long)addr);
     if (rc < 0) {
-        close(_fd);
+        os_close(_fd);
         _fd = 0;
         return rc;
     }
-
+    
     return 0;
 };
 
-std::vector<uint8_t> i2c_device_t::read_block_data(uint8_t command, uint32_t size) {
-    if (!_fd) return { };
+int i2c_device_t::start_mock() {
+    _mock = true;
+    return 0;
+}
 
-    if (size > I2C_SMBUS_BLOCK_MAX)
-        return { };
+void i2c_device_t::set_mock_time(std::chrono::steady_clock::time_point now) {
+    if (now > _mock_time) {
+        _mock_time = now;
+    }
+}
+
+void i2c_device_t::mock_pause(uint32_t usec) {
+    _mock_time += std::chrono::microseconds(usec);
+}
 
+int i2c_device_t::read_block_data(uint8_t command, uint8_t *data, uint32_t size) {
+    if (size > I2C_SMBUS_BLOCK_MAX)
+        return -1;
+    
+    if (_mock) {
+        // Address, command, address again and data bytes
+        auto begin = _mock_time;
+        _mock_time += std::chrono::nanoseconds((uint64_t)(size + 3) * I2C_MOCK_NS_PER_BYTE);
+        _reads++;
+        for (uint32_t i = 0; i < size; ++i)
+            data[i] = 0;
+        if (_capture) _capture->append(i2c_transfer_t::read_block, command, data, size, 0, begin, _mock_time);
+        return 0;
+    }
+    if (!_fd) return -1;
+    
     i2c_smbus_data smbus_data;
     smbus_data.block[0] = size;
-
+    
     i2c_smbus_ioctl_data ioctl_data;
     ioctl_data.size = I2C_SMBUS_I2C_BLOCK_DATA;
     ioctl_data.read_write = I2C_SMBUS_READ;
     ioctl_data.command = command;
     ioctl_data.data = &smbus_data;
-
-    int rc = ioctl(_fd, I2C_SMBUS, &ioctl_data);
-
-    if (rc < 0) return { };
-
-    std::vector<uint8_t> data;
+    
+    auto begin = _capture ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int rc = os_ioctl(_fd, I2C_SMBUS, &ioctl_data);
+    _reads++;
+    if (_capture) {
+        _capture->append(i2c_transfer_t::read_block, command, rc < 0 ? nullptr : smbus_data.block + 1, size,
+                         rc < 0 ? -errno : rc, begin, std::chrono::steady_clock::now());
+    }
+    
+    if (rc < 0) return rc;
+    
     for (uint32_t i = 0; i < size; ++i)
-        data.push_back(smbus_data.block[i + 1]);
-
-    return data;
+        data[i] = smbus_data.block[i + 1];
+    
+    return 0;
 }
 
-int i2c_device_t::write_block_data(uint8_t command, std::vector<uint8_t> data) {
+int i2c_device_t::write_block_data(uint8_t command, const uint8_t *data, uint32_t size) {
+    if (_mock) {
+        // Address, command and data bytes
+        auto begin = _mock_time;
+        _mock_time += std::chrono::nanoseconds((uint64_t)(size + 2) * I2C_MOCK_NS_PER_BYTE);
+        _last_write_end = _mock_time;
+        _writes++;
+        if (_capture) _capture->append(i2c_transfer_t::write_block, command, data, size, 0, begin, _mock_time);
+        return 0;
+    }
     if (!_fd) return -1;
-
-    uint32_t size = data.size();
+    
     if (size > I2C_SMBUS_BLOCK_MAX)
         size = I2C_SMBUS_BLOCK_MAX;
-
+    
     i2c_smbus_data smbus_data;
     smbus_data.block[0] = size;
     for (uint32_t i = 0; i < size; ++i)
         smbus_data.block[i + 1] = data[i];
-
+    
     i2c_smbus_ioctl_data ioctl_data;
     ioctl_data.size = I2C_SMBUS_I2C_BLOCK_DATA;
     ioctl_data.read_write = I2C_SMBUS_WRITE;
     ioctl_data.command = command;
     ioctl_data.data = &smbus_data;
-
-    int rc = ioctl(_fd, I2C_SMBUS, &ioctl_data);
-
+    
+    auto begin = _capture ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int rc = os_ioctl(_fd, I2C_SMBUS, &ioctl_data);
+    _last_write_end = std::chrono::steady_clock::now();
+    _writes++;
+    if (_capture) {
+        _capture->append(i2c_transfer_t::write_block, command, data, size, rc < 0 ? -errno : rc, begin,
+                         _last_write_end);
+    }
+    
     return rc;
 }
 
 uint8_t i2c_device_t::read_byte_data(uint8_t command) {
+    if (_mock) {
+        uint8_t ok = 1;
+        if (_capture) _capture->append(i2c_transfer_t::read_byte, command, &ok, 1, 0, _mock_time, _mock_time);
+        return ok;
+    }
     if (!_fd) return { };
-
+    
     i2c_smbus_data smbus_data;
-
+    
     i2c_smbus_ioctl_data ioctl_data;
     ioctl_data.size = I2C_SMBUS_BYTE_DATA;
     ioctl_data.read_write = I2C_SMBUS_READ;
     ioctl_data.command = command;
     ioctl_data.data = &smbus_data;
-
-    int rc = ioctl(_fd, I2C_SMBUS, &ioctl_data);
-
+    
+    auto begin = _capture ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+    int rc = os_ioctl(_fd, I2C_SMBUS, &ioctl_data);
+    if (_capture) {
+        _capture->append(i2c_transfer_t::read_byte, command, rc < 0 ? nullptr : &smbus_data.byte, 1,
+                         rc < 0 ? -errno : rc, begin, std::chrono::steady_clock::now());
+    }
+    
     if (rc < 0) return { };
-
+    
     return smbus_data.byte & 0xff;
 }
\ No newline at end of file
@@ -2,20 +2,47 @@
 #define __LEDCTL_I2C_H__
 
 #include <stdint.h>
-#include <vector>
+#include <chrono>
+
+#include "i2c_capture.h"
 
 class i2c_device_t {
 
 private:
     int _fd;
+    bool _mock;
+    uint64_t _writes;
+    uint64_t _reads;
+    i2c_capture_t* _capture;      // records every transfer when set
+    
+    // Mock only: a simulated bus clock, moved on by pauses and by the time
+    // each transfer would take on a 100 kHz bus
+    std::chrono::steady_clock::time_point _mock_time;
+    std::chrono::steady_clock::time_point _last_write_end;
 
 public:
-    i2c_device_t() : _fd(0) {}
+    i2c_device_t() : _fd(0), _mock(false), _writes(0), _reads(0), _capture(nullptr) {}
     ~i2c_device_t();
-
+    
     int start(const char *filename, uint16_t addr);
-    std::vector<uint8_t> read_block_data(uint8_t command, uint32_t size);
-    int write_block_data(uint8_t command, std::vector<uint8_t> data);
+    
+    // No bus access: writes only count, status reads report success, block
+    // reads return zeros
+    int start_mock();
+    uint64_t get_write_count() const { return _writes; }
+    uint64_t get_read_count() const { return _reads; }
+    bool is_mock() const { return _mock; }
+    
+    void set_capture(i2c_capture_t* capture) { _capture = capture; }
+    
+    // Simulated bus time: never behind now, pauses add to it, and when the
+    // last byte of the latest write was on the bus
+    void set_mock_time(std::chrono::steady_clock::time_point now);
+    void mock_pause(uint32_t usec);
+    std::chrono::steady_clock::time_point get_last_write_end() const { return _last_write_end; }
+    // Block transfers use the caller's buffer, nothing is allocated
+    int read_block_data(uint8_t command, uint8_t *data, uint32_t size);
+    int write_block_data(uint8_t command, const uint8_t *data, uint32_t size);
     uint8_t read_byte_data(uint8_t command);
 
 };
@@ -0,0 +1,108 @@
+#include "i2c_capture.h"
+#include "os.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <cerrno>
+#include <cstring>
+
+#define CAPTURE_MAGIC "LEDI2CC"
+#define CAPTURE_VERSION 1
+
+static_assert(sizeof(i2c_capture_record_t) == 32, "capture records are stored as they are");
+
+i2c_capture_t::i2c_capture_t() : _fd(-1), _mock(false) {
+}
+
+i2c_capture_t::~i2c_capture_t() {
+    if (_fd >= 0) {
+        os_close(_fd);
+    }
+}
+
+bool i2c_capture_t::create(const std::string& path, bool mock, std::chrono::steady_clock::time_point start) {
+    _fd = os_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        os_syslog(LOG_ERR, "Failed to create I2C capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header.version = CAPTURE_VERSION;
+    header.mock = mock ? 1 : 0;
+    
+    if (os_write(_fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+        os_syslog(LOG_ERR, "Failed to write I2C capture %s: %s", path.c_str(), strerror(errno));
+        os_close(_fd);
+        _fd = -1;
+        return false;
+    }
+    
+    _mock = mock;
+    _start = start;
+    os_syslog(LOG_INFO, "Capturing I2C transfers to %s", path.c_str());
+    return true;
+}
+
+void i2c_capture_t::append(i2c_transfer_t type, uint8_t command, const uint8_t* data, uint32_t size, int rc,
+                           std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+    if (_fd < 0) {
+        return;
+    }
+    
+    i2c_capture_record_t record;
+    memset(&record, 0, sizeof(record));
+    if (begin > _start) {
+        record.time_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(begin - _start).count();
+    }
+    record.latency_ns = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+    record.rc = (int16_t)(rc < INT16_MIN ? INT16_MIN : rc);
+    record.type = type;
+    record.command = command;
+    record.size = (uint8_t)(size > UINT8_MAX ? UINT8_MAX : size);
+    if (data) {
+        memcpy(record.data, data, size < I2C_CAPTURE_DATA_MAX ? size : I2C_CAPTURE_DATA_MAX);
+    }
+    
+    // One write per transfer, a crash loses at most the record being written
+    if (os_write(_fd, &record, sizeof(record)) != (ssize_t)sizeof(record)) {
+        os_syslog(LOG_WARNING, "Failed to write I2C capture record: %s, capture stopped", strerror(errno));
+        os_close(_fd);
+        _fd = -1;
+    }
+}
+
+bool i2c_capture_t::load(const std::string& path) {
+    int fd = os_open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        os_syslog(LOG_ERR, "Failed to open I2C capture %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    header_t header;
+    struct stat st;
+    bool valid = os_read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+                 memcmp(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0 &&
+                 header.version == CAPTURE_VERSION && fstat(fd, &st) == 0;
+    
+    if (valid) {
+        // A trailing partial record (crash while capturing) is dropped
+        size_t count = ((size_t)st.st_size - sizeof(header)) / sizeof(i2c_capture_record_t);
+        _records.resize(count);
+        ssize_t size = count * sizeof(i2c_capture_record_t);
+        valid = os_read(fd, _records.data(), size) == size;
+    }
+    os_close(fd);
+    
+    if (!valid) {
+        os_syslog(LOG_ERR, "%s is not an I2C capture of this version", path.c_str());
+        _records.clear();
+        return false;
+    }
+    
+    _mock = header.mock != 0;
+    return true;
+}
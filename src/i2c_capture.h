@@ -0,0 +1,64 @@
+#ifndef __LEDCTL_I2C_CAPTURE_H__
+#define __LEDCTL_I2C_CAPTURE_H__
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+// Kind of SMBus transfer
+enum class i2c_transfer_t : uint8_t {
+    write_block = 0, read_block, read_byte
+};
+
+// Longest payload kept per record, enough for a command frame and a status block
+#define I2C_CAPTURE_DATA_MAX 15
+
+// One transfer as stored in a capture file, 32 bytes
+struct i2c_capture_record_t {
+    uint64_t time_us;           // start of the transfer, since the capture was created
+    uint32_t latency_ns;        // until the transfer returned
+    int16_t rc;                 // 0 or the negative result of the ioctl
+    i2c_transfer_t type;
+    uint8_t command;
+    uint8_t size;               // payload bytes in the transfer, data holds the first ones
+    uint8_t data[I2C_CAPTURE_DATA_MAX];
+};
+
+// Binary capture of every transfer to the LED MCU, written with --capture
+// and rendered as LED operations with --decode. Real transfers are timed
+// on the clock, transfers on the mock bus with its simulated bus time.
+class i2c_capture_t {
+private:
+    struct header_t {
+        char magic[8];
+        uint32_t version;
+        uint32_t mock;          // captured on the mock bus
+    };
+    
+    int _fd;
+    bool _mock;
+    std::chrono::steady_clock::time_point _start;
+    std::vector<i2c_capture_record_t> _records;
+
+public:
+    i2c_capture_t();
+    ~i2c_capture_t();
+    i2c_capture_t(const i2c_capture_t&) = delete;
+    i2c_capture_t& operator=(const i2c_capture_t&) = delete;
+    
+    // Start a new capture file, start is time zero of its records
+    bool create(const std::string& path, bool mock, std::chrono::steady_clock::time_point start);
+    
+    // Append a transfer (capturing)
+    void append(i2c_transfer_t type, uint8_t command, const uint8_t* data, uint32_t size, int rc,
+                std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+    
+    // Load a whole capture into memory (decoding)
+    bool load(const std::string& path);
+    
+    const std::vector<i2c_capture_record_t>& get_records() const { return _records; }
+    bool is_mock() const { return _mock; }
+};
+
+#endif
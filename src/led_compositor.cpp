@@ -0,0 +1,321 @@
+#include "led_compositor.h"
+#include "os.h"
+#include <syslog.h>
+#include <unistd.h>
+
+led_compositor_t::led_compositor_t(led_controller_t& led_controller)
+    : _led_controller(led_controller), _yielded(0), _driven(0), _pending(false), _reconcile_next(0), _repairs(0) {
+    for (auto& layer : _layers) {
+        for (auto& target : layer) {
+            target = led_target_t{};
+        }
+    }
+    for (auto& target : _shadow) {
+        target = led_target_t{};
+    }
+    _color_known.fill(false);
+}
+
+void led_compositor_t::update_layer(led_layer_t layer, const led_frame_t& frame) {
+    led_frame_t& current = _layers[(size_t)layer];
+    for (size_t i = 0; i < frame.size(); ++i) {
+        if (frame[i].managed) {
+            current[i] = frame[i];
+        }
+    }
+}
+
+void led_compositor_t::set_layer_led(led_layer_t layer, led_controller_t::led_type_t id, const led_target_t& target) {
+    _layers[(size_t)layer][(size_t)id] = target;
+}
+
+void led_compositor_t::release_layer_led(led_layer_t layer, led_controller_t::led_type_t id) {
+    _layers[(size_t)layer][(size_t)id] = led_target_t{};
+}
+
+void led_compositor_t::clear_layer(led_layer_t layer) {
+    for (auto& target : _layers[(size_t)layer]) {
+        target = led_target_t{};
+    }
+}
+
+void led_compositor_t::compose(led_frame_t& frame) const {
+    // Topmost layer managing an LED wins
+    for (size_t i = 0; i < frame.size(); ++i) {
+        frame[i] = led_target_t{};
+        for (size_t layer = _layers.size(); layer-- > 0; ) {
+            if (_layers[layer][i].managed) {
+                frame[i] = _layers[layer][i];
+                break;
+            }
+        }
+    }
+}
+
+void led_compositor_t::set_yielded(uint32_t mask) {
+    for (size_t i = 0; i < _shadow.size(); ++i) {
+        if (mask & (1u << i)) {
+            _shadow[i].managed = false;
+            _color_known[i] = false;
+        }
+    }
+    _driven &= ~mask;
+    _yielded = mask;
+}
+
+bool led_compositor_t::commit() {
+    led_frame_t frame;
+    compose(frame);
+    
+    bool success = true;
+    bool wrote_previous = false;
+    bool locked = false;
+    
+    // An LED no layer manages any more is switched off once, then left alone
+    const led_target_t released_target = make_led_target(false, COLOR_OFF, 0);
+    
+    for (size_t i = 0; i < frame.size(); ++i) {
+        uint32_t bit = 1u << i;
+        bool released = !frame[i].managed;
+        if ((_yielded & bit) || (released && !(_driven & bit))) {
+            continue;
+        }
+        
+        const led_target_t& target = released ? released_target : frame[i];
+        auto id = (led_controller_t::led_type_t)i;
+        const led_target_t& last = _shadow[i];
+        bool on_changed = !last.managed || last.on != target.on;
+        bool color_changed = target.on && (!_color_known[i] ||
+                             last.color != target.color || last.brightness != target.brightness);
+        bool effect_changed = target.on && !is_same_effect(last, target);
+        if (!on_changed && !color_changed && !effect_changed) {
+            if (released) {
+                release_led(i);
+            }
+            continue;
+        }
+        
+        os_syslog(LOG_DEBUG, "Setting %s LED: %s, color=(%d,%d,%d)", led_controller_t::get_led_name(id),
+                  target.on ? "on" : "off", target.color.r, target.color.g, target.color.b);
+        
+        // Only taken once there is something to write, idle commits stay free
+        if (!locked) {
+            if (!_led_controller.lock_bus()) {
+                _pending = true;
+                return false;
+            }
+            locked = true;
+        }
+        
+        if (wrote_previous) {
+            _led_controller.pause(100000); // 100ms delay between LEDs
+        }
+        wrote_previous = true;
+        _driven |= bit;
+        
+        if (write_led(id, target) != 0) {
+            os_syslog(LOG_ERR, "Failed to set %s LED", led_controller_t::get_led_name(id));
+            _shadow[i].managed = false;
+            _color_known[i] = false;
+            success = false;
+        } else if (released) {
+            release_led(i);
+        }
+    }
+    
+    if (locked) {
+        _led_controller.unlock_bus();
+    }
+    _pending = !success;
+    return success;
+}
+
+void led_compositor_t::release_led(size_t index) {
+    _shadow[index] = led_target_t{};
+    _color_known[index] = false;
+    _driven &= ~(1u << index);
+}
+
+int led_compositor_t::write_led(led_controller_t::led_type_t id, const led_target_t& target) {
+    size_t index = (size_t)id;
+    led_target_t& last = _shadow[index];
+    
+    if (!target.on) {
+        int result = _led_controller.turn_off_led(id);
+        if (result == 0) {
+            // The MCU keeps color and brightness while the LED is off
+            last.managed = true;
+            last.on = false;
+        }
+        return result;
+    }
+    
+    int result = 0;
+    bool wrote = false;
+    
+    if (!_color_known[index] || last.color != target.color) {
+        result = _led_controller.set_rgb(id, target.color.r, target.color.g, target.color.b);
+        if (result != 0) return result;
+        wrote = true;
+    }
+    
+    if (!_color_known[index] || last.brightness != target.brightness) {
+        if (wrote) _led_controller.pause(10000); // 10ms between commands
+        result = _led_controller.set_brightness(id, target.brightness);
+        if (result != 0) return result;
+        wrote = true;
+    }
+    
+    last.color = target.color;
+    last.brightness = target.brightness;
+    _color_known[index] = true;
+    
+    // Blink and breath switch the LED on by themselves
+    if (!last.managed || !last.on || !is_same_effect(last, target)) {
+        if (wrote) _led_controller.pause(10000);
+        switch (target.effect) {
+            case led_effect_t::blink:
+                result = _led_controller.set_blink(id, target.t_on, target.t_off);
+                break;
+            case led_effect_t::breath:
+                result = _led_controller.set_breath(id, target.t_on, target.t_off);
+                break;
+            default:
+                result = _led_controller.set_onoff(id, 1);
+                break;
+        }
+        if (result != 0) return result;
+    }
+    
+    last.managed = true;
+    last.on = true;
+    last.effect = target.effect;
+    last.t_on = target.t_on;
+    last.t_off = target.t_off;
+    return 0;
+}
+
+bool led_compositor_t::reconcile_next() {
+    // Only LEDs with a known state on the MCU can be compared with it
+    size_t index = _shadow.size();
+    for (size_t n = 0; n < _shadow.size(); ++n) {
+        size_t i = (_reconcile_next + n) % _shadow.size();
+        if (_shadow[i].managed && !(_yielded & (1u << i))) {
+            index = i;
+            break;
+        }
+    }
+    if (index == _shadow.size()) {
+        return true;
+    }
+    _reconcile_next = index + 1;
+    
+    // Another writer mid-frame would be seen half done, the next slot will do
+    if (!_led_controller.try_lock_bus()) {
+        return true;
+    }
+    
+    auto id = (led_controller_t::led_type_t)index;
+    led_controller_t::led_data_t status = _led_controller.get_status(id);
+    bool success = true;
+    if (!status.is_available) {
+        os_syslog(LOG_DEBUG, "Cannot read back the %s LED", led_controller_t::get_led_name(id));
+    } else if (repair_led(id, status) != 0) {
+        os_syslog(LOG_ERR, "Failed to repair %s LED", led_controller_t::get_led_name(id));
+        _shadow[index].managed = false;
+        _color_known[index] = false;
+        success = false;
+    }
+    
+    _led_controller.unlock_bus();
+    return success;
+}
+
+int led_compositor_t::repair_led(led_controller_t::led_type_t id, const led_controller_t::led_data_t& status) {
+    typedef led_controller_t::op_mode_t op_mode_t;
+    size_t index = (size_t)id;
+    const led_target_t& last = _shadow[index];
+    
+    op_mode_t mode = op_mode_t::off;
+    if (last.on) {
+        mode = last.effect == led_effect_t::blink ? op_mode_t::blink :
+               last.effect == led_effect_t::breath ? op_mode_t::breath : op_mode_t::on;
+    }
+    bool mode_wrong = status.op_mode != mode ||
+                      ((mode == op_mode_t::blink || mode == op_mode_t::breath) &&
+                       (status.t_on != last.t_on || status.t_off != last.t_off));
+    bool color_wrong = _color_known[index] &&
+                       (status.color_r != last.color.r || status.color_g != last.color.g || status.color_b != last.color.b);
+    bool brightness_wrong = _color_known[index] && status.brightness != last.brightness;
+    if (!mode_wrong && !color_wrong && !brightness_wrong) {
+        return 0;
+    }
+    
+    os_syslog(LOG_INFO, "%s LED does not show what was written (%s%s%s), repairing", led_controller_t::get_led_name(id),
+              mode_wrong ? "mode " : "", color_wrong ? "color " : "", brightness_wrong ? "brightness " : "");
+    ++_repairs;
+    
+    // An LED that is off gets its color again when it is switched on
+    if (!last.on) {
+        if (color_wrong || brightness_wrong) {
+            _color_known[index] = false;
+        }
+        return mode_wrong ? _led_controller.turn_off_led(id) : 0;
+    }
+    
+    int result = 0;
+    bool wrote = false;
+    
+    if (color_wrong) {
+        result = _led_controller.set_rgb(id, last.color.r, last.color.g, last.color.b);
+        if (result != 0) return result;
+        wrote = true;
+    }
+    
+    if (brightness_wrong) {
+        if (wrote) _led_controller.pause(10000); // 10ms between commands
+        result = _led_controller.set_brightness(id, last.brightness);
+        if (result != 0) return result;
+        wrote = true;
+    }
+    
+    if (mode_wrong) {
+        if (wrote) _led_controller.pause(10000);
+        switch (last.effect) {
+            case led_effect_t::blink:
+                result = _led_controller.set_blink(id, last.t_on, last.t_off);
+                break;
+            case led_effect_t::breath:
+                result = _led_controller.set_breath(id, last.t_on, last.t_off);
+                break;
+            default:
+                result = _led_controller.set_onoff(id, 1);
+                break;
+        }
+    }
+    return result;
+}
+
+bool led_compositor_t::is_same_effect(const led_target_t& a, const led_target_t& b) {
+    if (a.effect != b.effect) {
+        return false;
+    }
+    return a.effect == led_effect_t::steady || (a.t_on == b.t_on && a.t_off == b.t_off);
+}
+
+const char* led_compositor_t::get_layer_name(led_layer_t layer) {
+    switch (layer) {
+        case led_layer_t::base:
+            return "base";
+        case led_layer_t::link_down:
+            return "link_down";
+        case led_layer_t::drop_alert:
+            return "drop_alert";
+        case led_layer_t::notification:
+            return "notification";
+        case led_layer_t::maintenance:
+            return "maintenance";
+        default:
+            return "unknown";
+    }
+}
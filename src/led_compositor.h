@@ -0,0 +1,111 @@
+#ifndef __LEDCTL_LED_COMPOSITOR_H__
+#define __LEDCTL_LED_COMPOSITOR_H__
+
+#include <array>
+
+#include "led_controller.h"
+
+// How a lit LED is driven
+enum class led_effect_t : uint8_t {
+    steady = 0, blink, breath
+};
+
+// Desired state of a single LED, led_target_t{} is an unmanaged LED
+struct led_target_t {
+    bool managed;           // false: leave the LED alone (or to a lower layer)
+    bool on;
+    rgb_color_t color;
+    uint8_t brightness;
+    led_effect_t effect;
+    uint16_t t_on, t_off;   // blink/breath timing in ms
+};
+
+inline led_target_t make_led_target(bool on, const rgb_color_t& color, uint8_t brightness,
+                                    led_effect_t effect = led_effect_t::steady,
+                                    uint16_t t_on = 0, uint16_t t_off = 0) {
+    return led_target_t{true, on, color, brightness, effect, t_on, t_off};
+}
+
+// Desired state of every LED, indexed by led_type_t
+typedef std::array<led_target_t, LEDCTL_LED_COUNT> led_frame_t;
+
+// Layers in priority order, a higher layer hides the ones below for the LEDs it manages
+enum class led_layer_t : uint8_t {
+    base = 0,           // utilization (network, disks)
+    link_down,          // link down alert
+    drop_alert,         // packet loss alert
+    notification,       // transient user notifications
+    maintenance,        // maintenance mode
+    count
+};
+
+// Merges the layers into one frame and sends only what differs from the
+// shadow (what was last written to the MCU). An LED that no layer manages
+// any more is switched off and then left alone.
+class led_compositor_t {
+private:
+    led_controller_t& _led_controller;
+    std::array<led_frame_t, (size_t)led_layer_t::count> _layers;
+    
+    // managed = on/off known, _color_known = color and brightness known
+    led_frame_t _shadow;
+    std::array<bool, LEDCTL_LED_COUNT> _color_known;
+    
+    // LEDs another tool has taken over (1 << led_type_t), never written
+    uint32_t _yielded;
+    
+    // LEDs written since they were last released or yielded (1 << led_type_t),
+    // switched off once no layer manages them any more
+    uint32_t _driven;
+    
+    // The last commit did not get everything to the MCU
+    bool _pending;
+    
+    // Readback: the LED to read next and how many LEDs needed a repair
+    size_t _reconcile_next;
+    uint64_t _repairs;
+    
+    int write_led(led_controller_t::led_type_t id, const led_target_t& target);
+    void release_led(size_t index);
+    int repair_led(led_controller_t::led_type_t id, const led_controller_t::led_data_t& status);
+    static bool is_same_effect(const led_target_t& a, const led_target_t& b);
+
+public:
+    explicit led_compositor_t(led_controller_t& led_controller);
+    
+    // Merge the managed LEDs of frame into a layer (unmanaged ones are left as they are)
+    void update_layer(led_layer_t layer, const led_frame_t& frame);
+    
+    // Set or release a single LED of a layer
+    void set_layer_led(led_layer_t layer, led_controller_t::led_type_t id, const led_target_t& target);
+    void release_layer_led(led_layer_t layer, led_controller_t::led_type_t id);
+    
+    // Release every LED of a layer
+    void clear_layer(led_layer_t layer);
+    
+    // Merge the layers and write the differences under the bus lock, returns
+    // false if any write failed (failed LEDs are rewritten in full on the
+    // next commit) or the lock was not available (nothing was written)
+    bool commit();
+    
+    // The last commit failed or was put off, commit() again to retry
+    bool is_pending() const { return _pending; }
+    
+    // Build the merged frame without writing it
+    void compose(led_frame_t& frame) const;
+    
+    // Leave LEDs to another tool. Their state on the MCU is unknown from
+    // then on, so they are written in full once they are given back.
+    void set_yielded(uint32_t mask);
+    uint32_t get_yielded() const { return _yielded; }
+    
+    // Read the next LED whose state is known (round-robin) back from the MCU
+    // and rewrite only the fields that differ from the shadow. Put off while
+    // another tool holds the bus, false if a repair failed.
+    bool reconcile_next();
+    uint64_t get_repair_count() const { return _repairs; }
+    
+    static const char* get_layer_name(led_layer_t layer);
+};
+
+#endif
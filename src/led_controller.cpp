@@ -1,46 +1,170 @@
 #include "led_controller.h"
+#include "sys_root.h"
+#include "os.h"
 #include <string>
-#include <filesystem>
-#include <fstream>
-#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
 #include <syslog.h>
 #include <unistd.h>
 
 #define I2C_DEV_PATH  "/sys/class/i2c-dev/"
 
-int led_controller_t::start() {
-    namespace fs = std::filesystem;
+// The adapter's device/name without the newline, false if there is no such adapter
+static bool read_adapter_name(const std::string& adapter, char* name, size_t size) {
+    if (!read_small_file(sys_path(I2C_DEV_PATH + adapter + "/device/name"), name, size)) {
+        return false;
+    }
+    name[strcspn(name, "\n")] = '\0';
+    return true;
+}
 
-    if (!fs::exists(I2C_DEV_PATH)) {
-        syslog(LOG_ERR, "I2C device path %s does not exist", I2C_DEV_PATH);
-        return -1;
+static bool is_led_adapter(const led_bus_t& bus, const char* name) {
+    for (const std::string& pattern : bus.adapters) {
+        if (fnmatch(pattern.c_str(), name, 0) == 0) {
+            return true;
+        }
     }
+    return false;
+}
 
-    for (const auto& entry : fs::directory_iterator(I2C_DEV_PATH)) {
-        if (entry.is_directory()) {
-            std::ifstream ifs(entry.path() / "device/name");
-            std::string line;
-            std::getline(ifs, line);
-
-            if (line.rfind("SMBus I801 adapter", 0) == 0) {
-                const auto i2c_dev = "/dev/" + entry.path().filename().string();
-                int result = _i2c.start(i2c_dev.c_str(), LEDCTL_LED_I2C_ADDR);
-                if (result == 0) {
-                    syslog(LOG_INFO, "LED controller initialized on %s", i2c_dev.c_str());
-                } else {
-                    syslog(LOG_ERR, "Failed to initialize LED controller on %s", i2c_dev.c_str());
-                }
-                return result;
-            }
+// First adapter (i2c-N) whose name matches one of the patterns
+static bool find_adapter(const led_bus_t& bus, std::string& adapter) {
+    const std::string i2c_dev_path = sys_path(I2C_DEV_PATH);
+    DIR* dir = opendir(i2c_dev_path.c_str());
+    if (!dir) {
+        os_syslog(LOG_ERR, "I2C device path %s does not exist", i2c_dev_path.c_str());
+        return false;
+    }
+
+    bool found = false;
+    struct dirent* entry;
+    while (!found && (entry = readdir(dir)) != nullptr) {
+        // Entries are symlinks to the adapters, only those have a device/name
+        char name[64];
+        found = entry->d_name[0] != '.' && read_adapter_name(entry->d_name, name, sizeof(name)) &&
+                is_led_adapter(bus, name);
+        if (found) {
+            adapter = entry->d_name;
+            os_syslog(LOG_DEBUG, "Found I2C adapter %s (%s)", entry->d_name, name);
         }
     }
+    closedir(dir);
+
+    if (!found) {
+        os_syslog(LOG_ERR, "No compatible I2C adapter found");
+    }
+    return found;
+}
+
+// The cache holds "i2c-N<TAB>device/name" of the adapter the MCU last
+// answered on. It is only trusted while that adapter still has that name
+// (adapter numbers follow probe order and can change across boots).
+static bool read_cached_adapter(const led_bus_t& bus, std::string& adapter) {
+    char cached[128];
+    if (bus.cache_path.empty() || !read_small_file(sys_path(bus.cache_path), cached, sizeof(cached))) {
+        return false;
+    }
+    cached[strcspn(cached, "\n")] = '\0';
+    char* tab = strchr(cached, '\t');
+    if (!tab) {
+        return false;
+    }
+    *tab = '\0';
+    
+    char name[64];
+    if (!read_adapter_name(cached, name, sizeof(name)) || strcmp(name, tab + 1) != 0 || !is_led_adapter(bus, name)) {
+        os_syslog(LOG_INFO, "Cached I2C adapter %s (%s) is gone or no longer matches, scanning", cached, tab + 1);
+        return false;
+    }
+    adapter = cached;
+    return true;
+}
 
-    syslog(LOG_ERR, "No compatible I2C adapter found");
-    return -1;
+static void write_cached_adapter(const led_bus_t& bus, const std::string& adapter) {
+    char name[64];
+    if (bus.cache_path.empty() || !read_adapter_name(adapter, name, sizeof(name))) {
+        return;
+    }
+    
+    std::string path = sys_path(bus.cache_path);
+    std::string line = adapter + "\t" + name + "\n";
+    int fd = os_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || os_write(fd, line.data(), line.size()) != (ssize_t)line.size()) {
+        // Only costs a scan on the next start
+        os_syslog(LOG_DEBUG, "Cannot write the I2C adapter cache %s: %s", path.c_str(), strerror(errno));
+    }
+    if (fd >= 0) {
+        os_close(fd);
+    }
+}
+
+int led_controller_t::open_adapter(const std::string& adapter, uint8_t address) {
+    const std::string i2c_dev = sys_path("/dev/" + adapter);
+    
+    // A fake tree (--root) has a plain file in place of the device node
+    struct stat st;
+    if (!get_sys_root().empty() && stat(i2c_dev.c_str(), &st) == 0 && !S_ISCHR(st.st_mode)) {
+        os_syslog(LOG_INFO, "%s is not a device node, using the mock LED sink", i2c_dev.c_str());
+        return start_mock();
+    }
+    
+    int result = _i2c.start(i2c_dev.c_str(), address);
+    if (result == 0) {
+        os_syslog(LOG_INFO, "LED controller initialized on %s at 0x%02x", i2c_dev.c_str(), address);
+    } else {
+        os_syslog(LOG_ERR, "Failed to initialize LED controller on %s at 0x%02x", i2c_dev.c_str(), address);
+    }
+    return result;
+}
+
+int led_controller_t::start(const led_bus_t& bus) {
+    if (!bus.lock_path.empty()) {
+        _bus_lock.open(sys_path(bus.lock_path), bus.lock_timeout_ms);
+    }
+
+    // An explicit bus is used as it is, whatever its adapter is called
+    if (bus.bus >= 0) {
+        return open_adapter("i2c-" + std::to_string(bus.bus), bus.address);
+    }
+    
+    std::string adapter;
+    if (read_cached_adapter(bus, adapter)) {
+        if (open_adapter(adapter, bus.address) == 0) {
+            return 0;
+        }
+        os_syslog(LOG_INFO, "Cached I2C adapter %s failed, scanning", adapter.c_str());
+    }
+    
+    if (!find_adapter(bus, adapter)) {
+        return -1;
+    }
+    int result = open_adapter(adapter, bus.address);
+    if (result == 0) {
+        write_cached_adapter(bus, adapter);
+    }
+    return result;
 }
 
-static int compute_checksum(const std::vector<uint8_t>& data, int size) {
-    if (size < 2 || size > (int)data.size()) 
+int led_controller_t::start_mock() {
+    _mock = true;
+    os_syslog(LOG_INFO, "LED controller in mock mode");
+    return _i2c.start_mock();
+}
+
+void led_controller_t::pause(unsigned int usec) {
+    if (_mock) {
+        _i2c.mock_pause(usec);
+    } else {
+        os_sleep_us(usec);
+    }
+}
+
+int led_controller_t::compute_checksum(const uint8_t* data, int size) {
+    if (size < 2) 
         return 0;
 
     int sum = 0;
@@ -50,18 +174,16 @@ static int compute_checksum(const std::vector<uint8_t>& data, int size) {
     return sum;
 }
 
-static bool verify_checksum(const std::vector<uint8_t>& data) {
-    int size = data.size();
+bool led_controller_t::verify_checksum(const uint8_t* data, int size) {
     if (size < 2) return false;
     int sum = compute_checksum(data, size - 2);
     return sum != 0 && sum == (data[size - 1] | (((int)data[size - 2]) << 8));
 }
 
-static void append_checksum(std::vector<uint8_t>& data) {
-    int size = data.size();
+void led_controller_t::append_checksum(uint8_t* data, int size) {
     int sum = compute_checksum(data, size);
-    data.push_back((sum >> 8) & 0xff);
-    data.push_back(sum & 0xff);
+    data[size] = (sum >> 8) & 0xff;
+    data[size + 1] = sum & 0xff;
 }
 
 // High-level interface methods
@@ -75,27 +197,27 @@ int led_controller_t::set_led_state(led_type_t id, bool on, const rgb_color_t& c
     // Set color first
     result = set_rgb(id, color.r, color.g, color.b);
     if (result != 0) {
-        syslog(LOG_ERR, "Failed to set RGB for LED %d", (int)id);
+        os_syslog(LOG_ERR, "Failed to set RGB for LED %d", (int)id);
         return result;
     }
     
     // Small delay between operations
-    usleep(10000); // 10ms
+    pause(10000); // 10ms
     
     // Set brightness
     result = set_brightness(id, brightness);
     if (result != 0) {
-        syslog(LOG_ERR, "Failed to set brightness for LED %d", (int)id);
+        os_syslog(LOG_ERR, "Failed to set brightness for LED %d", (int)id);
         return result;
     }
     
     // Small delay between operations
-    usleep(10000); // 10ms
+    pause(10000); // 10ms
     
     // Turn on
     result = set_onoff(id, 1);
     if (result != 0) {
-        syslog(LOG_ERR, "Failed to turn on LED %d", (int)id);
+        os_syslog(LOG_ERR, "Failed to turn on LED %d", (int)id);
     }
     
     return result;
@@ -108,41 +230,31 @@ int led_controller_t::turn_off_led(led_type_t id) {
 int led_controller_t::turn_off_all_leds() {
     int result = 0;
     
-    // Turn off each LED individually with delays and error checking
-    result = turn_off_led(led_type_t::power);
-    if (result != 0) {
-        syslog(LOG_ERR, "Failed to turn off power LED");
-    }
-    usleep(20000); // 20ms delay
+    // Goes ahead even if another tool keeps the bus, the service is stopping
+    lock_bus();
     
-    int temp_result = turn_off_led(led_type_t::netdev);
-    if (temp_result != 0) {
-        syslog(LOG_ERR, "Failed to turn off netdev LED");
-        result |= temp_result;
-    }
-    usleep(20000);
-    
-    temp_result = turn_off_led(led_type_t::disk1);
-    if (temp_result != 0) {
-        syslog(LOG_ERR, "Failed to turn off disk1 LED");
-        result |= temp_result;
-    }
-    usleep(20000);
-    
-    temp_result = turn_off_led(led_type_t::disk2);
-    if (temp_result != 0) {
-        syslog(LOG_ERR, "Failed to turn off disk2 LED");
-        result |= temp_result;
+    // Turn off each LED individually with delays and error checking
+    for (size_t i = 0; i < LEDCTL_LED_COUNT; ++i) {
+        auto id = (led_type_t)i;
+        if (i > 0) {
+            pause(20000); // 20ms delay
+        }
+        int temp_result = turn_off_led(id);
+        if (temp_result != 0) {
+            os_syslog(LOG_ERR, "Failed to turn off %s LED", get_led_name(id));
+            result |= temp_result;
+        }
     }
     
     // Additional verification - try to verify the operation was successful
     if (result == 0) {
-        usleep(50000); // Wait 50ms for operations to complete
+        pause(50000); // Wait 50ms for operations to complete
         if (!is_last_modification_successful()) {
-            syslog(LOG_WARNING, "LED controller reports last modification was not successful");
+            os_syslog(LOG_WARNING, "LED controller reports last modification was not successful");
             result = -1;
         }
     }
+    unlock_bus();
     
     return result;
 }
@@ -152,8 +264,14 @@ led_controller_t::led_data_t led_controller_t::get_status(led_type_t id) {
     led_data_t data { };
     data.is_available = false;
 
-    auto raw_data = _i2c.read_block_data(0x81 + (uint8_t)id, 0xb);
-    if (raw_data.size() != 0xb || !verify_checksum(raw_data)) 
+    uint8_t raw_data[LEDCTL_STATUS_SIZE];
+    if (_i2c.read_block_data(0x81 + (uint8_t)id, raw_data, sizeof(raw_data)) != 0)
+        return data;
+    
+    if (_mock)
+        return (uint8_t)id < LEDCTL_LED_COUNT ? _mock_leds[(uint8_t)id] : data;
+    
+    if (!verify_checksum(raw_data, sizeof(raw_data))) 
         return data;
 
     switch (raw_data[0]) {
@@ -178,7 +296,7 @@ led_controller_t::led_data_t led_controller_t::get_status(led_type_t id) {
 }
 
 int led_controller_t::_change_status(led_type_t id, uint8_t command, std::array<std::optional<uint8_t>, 4> params) {
-    std::vector<uint8_t> data {
+    uint8_t data[LEDCTL_FRAME_SIZE] {
     //   3c    3b    3a
         0x00, 0xa0, 0x01,
     //     39        38         37
@@ -190,9 +308,36 @@ int led_controller_t::_change_status(led_type_t id, uint8_t command, std::array<
         params[3].value_or(0x00), 
     };
 
-    append_checksum(data);
+    append_checksum(data, LEDCTL_FRAME_SIZE - 2);
     data[0] = (uint8_t)id;
-    return _i2c.write_block_data((uint8_t)id, data);
+    int result = _i2c.write_block_data((uint8_t)id, data, LEDCTL_FRAME_SIZE);
+    if (_mock && (uint8_t)id < LEDCTL_LED_COUNT) {
+        update_mock_led(_mock_leds[(uint8_t)id], command, data + 6);
+    }
+    return result;
+}
+
+void led_controller_t::update_mock_led(led_data_t& led, uint8_t command, const uint8_t* params) {
+    led.is_available = true;
+    switch (command) {
+        case 0x01:
+            led.brightness = params[0];
+            break;
+        case 0x02:
+            led.color_r = params[0];
+            led.color_g = params[1];
+            led.color_b = params[2];
+            break;
+        case 0x03:
+            led.op_mode = params[0] ? op_mode_t::on : op_mode_t::off;
+            break;
+        case 0x04:
+        case 0x05:
+            led.op_mode = command == 0x04 ? op_mode_t::blink : op_mode_t::breath;
+            led.t_on = (uint16_t)((params[2] << 8) | params[3]);
+            led.t_off = (uint16_t)(((params[0] << 8) | params[1]) - led.t_on);
+            break;
+    }
 }
 
 int led_controller_t::set_onoff(led_type_t id, uint8_t status) {
@@ -229,4 +374,86 @@ int led_controller_t::set_blink(led_type_t id, uint16_t t_on, uint16_t t_off) {
 
 int led_controller_t::set_breath(led_type_t id, uint16_t t_on, uint16_t t_off) {
     return _set_blink_or_breath(0x05, id, t_on, t_off);
-}
\ No newline at end of file
+}
+
+const char* led_controller_t::get_led_name(led_type_t id) {
+    static const char* names[LEDCTL_LED_COUNT] = {
+        "power", "netdev", "disk1", "disk2", "disk3", "disk4", "disk5", "disk6", "disk7", "disk8"
+    };
+    uint8_t index = (uint8_t)id;
+    return index < LEDCTL_LED_COUNT ? names[index] : "unknown";
+}
+
+bool led_controller_t::parse_led_name(const std::string& name, led_type_t& id) {
+    for (uint8_t i = 0; i < LEDCTL_LED_COUNT; ++i) {
+        if (name == get_led_name((led_type_t)i)) {
+            id = (led_type_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void led_controller_t::describe_transfer(const i2c_capture_record_t& record, bool mock, char* text, size_t size) {
+    static const char* modes[] = { "off", "on", "blink", "breath" };
+    const uint8_t* data = record.data;
+    int used = 0;
+    
+    if (record.type == i2c_transfer_t::write_block && record.size == LEDCTL_FRAME_SIZE) {
+        // Command frame of _change_status, the checksum was taken with the LED byte zeroed
+        uint8_t frame[LEDCTL_FRAME_SIZE];
+        memcpy(frame, data, sizeof(frame));
+        frame[0] = 0;
+        const char* name = get_led_name((led_type_t)record.command);
+        uint16_t t_high = (uint16_t)((data[6] << 8) | data[7]);
+        uint16_t t_low = (uint16_t)((data[8] << 8) | data[9]);
+        switch (data[5]) {
+            case 0x01:
+                used = snprintf(text, size, "%s set_brightness(%u)", name, data[6]);
+                break;
+            case 0x02:
+                used = snprintf(text, size, "%s set_rgb(%u,%u,%u)", name, data[6], data[7], data[8]);
+                break;
+            case 0x03:
+                used = snprintf(text, size, "%s set_onoff(%u)", name, data[6]);
+                break;
+            case 0x04:
+            case 0x05:
+                used = snprintf(text, size, "%s set_%s(%u,%u)", name, data[5] == 0x04 ? "blink" : "breath",
+                                t_low, (uint16_t)(t_high - t_low));
+                break;
+            default:
+                used = snprintf(text, size, "%s command 0x%02x", name, data[5]);
+                break;
+        }
+        if (!verify_checksum(frame, sizeof(frame)) && used >= 0 && (size_t)used < size) {
+            used += snprintf(text + used, size - used, " [bad checksum]");
+        }
+    } else if (record.type == i2c_transfer_t::read_block && record.command >= 0x81 &&
+               record.command < 0x81 + LEDCTL_LED_COUNT && record.size == LEDCTL_STATUS_SIZE) {
+        // Status block of get_status
+        used = snprintf(text, size, "%s get_status()", get_led_name((led_type_t)(record.command - 0x81)));
+        if (record.rc == 0 && !mock && used >= 0 && (size_t)used < size) {
+            if (!verify_checksum(data, LEDCTL_STATUS_SIZE) || data[0] > 3) {
+                used += snprintf(text + used, size - used, " = [bad checksum]");
+            } else {
+                uint16_t t_high = (uint16_t)((data[5] << 8) | data[6]);
+                uint16_t t_low = (uint16_t)((data[7] << 8) | data[8]);
+                used += snprintf(text + used, size - used, " = %s, brightness %u, rgb(%u,%u,%u), %u/%u ms",
+                                 modes[data[0]], data[1], data[2], data[3], data[4], t_low, (uint16_t)(t_high - t_low));
+            }
+        }
+    } else if (record.type == i2c_transfer_t::read_byte && record.command == 0x80) {
+        used = snprintf(text, size, "last_modification()");
+        if (record.rc == 0 && used >= 0 && (size_t)used < size) {
+            used += snprintf(text + used, size - used, " = %u", data[0]);
+        }
+    } else {
+        static const char* types[] = { "write", "read", "read_byte" };
+        used = snprintf(text, size, "%s 0x%02x, %u bytes", types[(size_t)record.type % 3], record.command, record.size);
+    }
+    
+    if (record.rc < 0 && used >= 0 && (size_t)used < size) {
+        snprintf(text + used, size - used, " failed: %s", strerror(-record.rc));
+    }
+}
@@ -3,8 +3,11 @@
 
 #include <array>
 #include <optional>
+#include <string>
+#include <vector>
 
 #include "i2c.h"
+#include "bus_lock.h"
 
 // LED type definitions
 #define LEDCTL_LED_POWER    led_controller_t::led_type_t::power
@@ -13,12 +16,29 @@
 #define LEDCTL_LED_DISK2    led_controller_t::led_type_t::disk2
 
 #define LEDCTL_LED_I2C_ADDR  0x3a
+#define LEDCTL_LED_COUNT     10
+
+// Command frame: 10 bytes of payload and a 2 byte checksum
+#define LEDCTL_FRAME_SIZE    12
+
+// Status block of one LED: 9 bytes of state and a 2 byte checksum, on the bus
+// with the address, the command and the address again
+#define LEDCTL_STATUS_SIZE       11
+#define LEDCTL_STATUS_BUS_BYTES  (LEDCTL_STATUS_SIZE + 3)
 
 // Color constants
 struct rgb_color_t {
     uint8_t r, g, b;
 };
 
+inline bool operator==(const rgb_color_t& a, const rgb_color_t& b) {
+    return a.r == b.r && a.g == b.g && a.b == b.b;
+}
+
+inline bool operator!=(const rgb_color_t& a, const rgb_color_t& b) {
+    return !(a == b);
+}
+
 // Predefined colors
 const rgb_color_t COLOR_WHITE = {255, 255, 255};
 const rgb_color_t COLOR_GREEN = {0, 255, 0};
@@ -29,9 +49,30 @@ const rgb_color_t COLOR_OFF = {0, 0, 0};
 // Default brightness
 const uint8_t DEFAULT_BRIGHTNESS = 255;
 
+// Where the LED MCU sits (the i2c_* settings in [leds])
+struct led_bus_t {
+    int bus;                                 // i2c-N, -1 = find the adapter by name
+    uint8_t address;
+    std::vector<std::string> adapters;       // fnmatch patterns for the adapter's device/name
+    std::string cache_path;                  // last adapter that worked, empty = always scan
+    std::string lock_path;                   // advisory lock shared with other tools, empty = none
+    uint32_t lock_timeout_ms;                // longest wait for the lock before a frame is put off
+    
+    led_bus_t()
+        : bus(-1)
+        , address(LEDCTL_LED_I2C_ADDR)
+        , adapters{"SMBus I801 adapter*"}
+        , cache_path("/run/ugreen_leds_ethutild/adapter")
+        , lock_path("/run/lock/ugreen-leds.lock")
+        , lock_timeout_ms(500)
+    {}
+};
+
 class led_controller_t {
 
     i2c_device_t _i2c;
+    bus_lock_t _bus_lock;
+    bool _mock;
 
 public:
 
@@ -51,8 +92,36 @@ public:
         uint16_t t_on, t_off;
     };
 
+private:
+    // Mock only: what the MCU would report, following the commands sent
+    std::array<led_data_t, LEDCTL_LED_COUNT> _mock_leds;
+
 public:
-    int start();
+    led_controller_t() : _mock(false), _mock_leds{} {}
+    
+    // Open the MCU on the configured bus, else on the cached adapter if its
+    // name still matches, else on the first adapter whose name matches
+    int start(const led_bus_t& bus = led_bus_t());
+    
+    // Mock LED sink for replays: nothing reaches the bus, pauses only move the mock bus clock on
+    int start_mock();
+    bool is_mock() const { return _mock; }
+    uint64_t get_write_count() const { return _i2c.get_write_count(); }
+    uint64_t get_read_count() const { return _i2c.get_read_count(); }
+    void set_mock_time(std::chrono::steady_clock::time_point now) { _i2c.set_mock_time(now); }
+    std::chrono::steady_clock::time_point get_last_write_end() const { return _i2c.get_last_write_end(); }
+    
+    // Record every transfer to the MCU (--capture)
+    void set_capture(i2c_capture_t* capture) { _i2c.set_capture(capture); }
+    
+    // Delay between commands, the MCU drops commands sent back to back
+    void pause(unsigned int usec);
+    
+    // Hold the bus for a whole frame, false if another tool kept it too long
+    bool lock_bus() { return _bus_lock.acquire(); }
+    bool try_lock_bus() { return _bus_lock.try_acquire(); }
+    void unlock_bus() { _bus_lock.release(); }
+    uint64_t get_bus_wait_count() const { return _bus_lock.get_wait_count(); }
     
     // High-level interface for the service
     int set_led_state(led_type_t id, bool on, const rgb_color_t& color = COLOR_WHITE, uint8_t brightness = DEFAULT_BRIGHTNESS);
@@ -69,9 +138,25 @@ public:
 
     bool is_last_modification_successful();
 
+    // LED names as used in the config file ("power", "netdev", "disk1"...)
+    static const char* get_led_name(led_type_t id);
+    static bool parse_led_name(const std::string& name, led_type_t& id);
+    
+    // Frame checksum of the MCU protocol: 16 bit sum, big endian, after the payload
+    static int compute_checksum(const uint8_t* data, int size);
+    static bool verify_checksum(const uint8_t* data, int size);
+    // Writes the checksum of size bytes to data[size] and data[size + 1]
+    static void append_checksum(uint8_t* data, int size);
+
+    // A captured transfer as an LED operation, e.g. "disk1 set_rgb(0,0,255)".
+    // Reads on the mock bus return nothing, only the request is shown.
+    static void describe_transfer(const i2c_capture_record_t& record, bool mock, char* text, size_t size);
+
 private:
+    int open_adapter(const std::string& adapter, uint8_t address);
     int _set_blink_or_breath(uint8_t command, led_type_t id, uint16_t t_on, uint16_t t_off);
     int _change_status(led_type_t id, uint8_t command, std::array<std::optional<uint8_t>, 4> params);
+    static void update_mock_led(led_data_t& led, uint8_t command, const uint8_t* params);
 };
 
 #endif
\ No newline at end of file
@@ -1,32 +1,165 @@
 #include "led_state_manager.h"
+#include "sys_root.h"
+#include "os.h"
 #include <syslog.h>
 #include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static led_controller_t::led_type_t resolve_led(const std::string& name, led_controller_t::led_type_t fallback) {
+    led_controller_t::led_type_t id;
+    if (led_controller_t::parse_led_name(name, id)) {
+        return id;
+    }
+    os_syslog(LOG_WARNING, "Unknown LED name: %s, using %s", name.c_str(), led_controller_t::get_led_name(fallback));
+    return fallback;
+}
 
 led_state_manager_t::led_state_manager_t(led_controller_t& led_controller, const ledctl_config_t& config)
-    : _led_controller(led_controller), _current_state(led_state_t::UTILIZATION_OFF),
-      _brightness(config.brightness), _low_threshold(config.low_threshold),
-      _medium_threshold(config.medium_threshold), _high_threshold(config.high_threshold) {
+    : _compositor(led_controller), _current_state(0), _brightness(config.brightness),
+      _per_direction(config.display_mode == "per_direction"),
+      _rx_led(resolve_led(config.rx_led, LEDCTL_LED_NETDEV)),
+      _tx_led(resolve_led(config.tx_led, LEDCTL_LED_DISK1)),
+      _rx_capacity_mbps(config.rx_capacity_mbps), _tx_capacity_mbps(config.tx_capacity_mbps),
+      _rx_state(0), _tx_state(0),
+      _peak_enabled(config.peak_enabled), _peak_hold_ms(config.peak_hold_ms),
+      _peak_decay_percentage(config.peak_decay_percentage),
+      _min_update(config.peak_enabled ? config.peak_min_update_ms : 0),
+      _disks_enabled(config.disks_enabled), _disk_count(0), _disk_states_applied(false),
+      _alert_drop_rate(config.alert_drop_rate), _alert_error_rate(config.alert_error_rate),
+      _alert_led(resolve_led(config.alert_led, LEDCTL_LED_POWER)),
+      _alert_target(make_led_target(true, config.alert_color, config.brightness, led_effect_t::blink,
+                                    config.alert_blink_on_ms, config.alert_blink_off_ms)),
+      _alert_hold(config.alert_hold_ms), _alert_active(false),
+      _link_down_alert(config.alert_link_down), _link_up(true), _maintenance(false),
+      _readback_interval(config.readback_bytes_per_s
+                         ? std::chrono::milliseconds(LEDCTL_STATUS_BUS_BYTES * 1000 / config.readback_bytes_per_s)
+                         : std::chrono::milliseconds(0)) {
+    _notification_active.fill(false);
+    _disk_states.fill(0);
+    if (!config.yield_lease.empty()) {
+        _lease.set_path(sys_path(config.yield_lease));
+    }
+    
+    if (config.levels.empty()) {
+        // Built-in table, per-direction thresholds come from [rx] and [tx]
+        _levels.load(level_table_t::make_default(config.low_threshold, config.medium_threshold,
+                                                 config.high_threshold, _brightness));
+        _rx_levels.load(level_table_t::make_default(config.rx_low_threshold, config.rx_medium_threshold,
+                                                    config.rx_high_threshold, _brightness));
+        _tx_levels.load(level_table_t::make_default(config.tx_low_threshold, config.tx_medium_threshold,
+                                                    config.tx_high_threshold, _brightness));
+    } else {
+        _levels.load(config.levels);
+        _rx_levels.load(config.levels);
+        _tx_levels.load(config.levels);
+    }
+    _disk_levels = _levels;
+    
+    if (_disks_enabled) {
+        // disk1 is led_type_t 2, as many bays as there are disk LEDs
+        size_t ports = 1;
+        for (char c : config.disk_ports) {
+            if (c == ',') ports++;
+        }
+        _disk_count = std::min(ports, (size_t)LEDCTL_LED_COUNT - (size_t)LEDCTL_LED_DISK1);
+        _disk_levels.set_capacity(config.disk_capacity_mbs);
+        
+        if (is_disk_led(_rx_led) || is_disk_led(_tx_led)) {
+            os_syslog(LOG_WARNING, "rx_led/tx_led overlap with disk LEDs, disk throughput takes precedence");
+        }
+    }
+    
+    compile_levels();
+    
+    uint32_t capacity = config.capacity_mbps ? config.capacity_mbps : DEFAULT_CAPACITY_MBPS;
+    set_capacity_mbps(capacity, capacity / 2);
+    
+    if (_per_direction) {
+        os_syslog(LOG_INFO, "Per-direction mode: RX on %s, TX on %s",
+                  led_controller_t::get_led_name(_rx_led), led_controller_t::get_led_name(_tx_led));
+    }
+}
+
+void led_state_manager_t::compile_levels() {
+    // LEDs lit by any level belong to the table and are off in levels that don't light them
+    uint32_t used = 0;
+    for (size_t i = 0; i < _levels.size(); ++i) {
+        used |= _levels.get(i).leds;
+    }
+    
+    _level_frames.resize(_levels.size());
+    for (size_t i = 0; i < _levels.size(); ++i) {
+        const led_level_t& level = _levels.get(i);
+        led_frame_t& frame = _level_frames[i];
+        build_base_frame(frame);
+        
+        for (size_t id = 0; id < frame.size(); ++id) {
+            uint32_t bit = 1u << id;
+            if (!(used & bit) || is_disk_led((led_controller_t::led_type_t)id)) {
+                continue;
+            }
+            frame[id] = (level.leds & bit) ? _levels.get_target(i) : make_led_target(false, COLOR_OFF, level.brightness);
+        }
+        
+        os_syslog(LOG_DEBUG, "Level %zu (%s): from %u%%, LEDs 0x%x, color (%u,%u,%u)", i, level.name.c_str(),
+                  level.threshold, level.leds, level.color.r, level.color.g, level.color.b);
+    }
+}
+
+void led_state_manager_t::set_capacity_mbps(uint32_t capacity_mbps, uint32_t direction_capacity_mbps) {
+    _levels.set_capacity(capacity_mbps);
+    
+    uint32_t rx_capacity = _rx_capacity_mbps ? _rx_capacity_mbps : direction_capacity_mbps;
+    uint32_t tx_capacity = _tx_capacity_mbps ? _tx_capacity_mbps : direction_capacity_mbps;
+    _rx_levels.set_capacity(rx_capacity);
+    _tx_levels.set_capacity(tx_capacity);
+    
+    _peak_total.configure(_peak_hold_ms, capacity_mbps * _peak_decay_percentage / 100.0);
+    _peak_rx.configure(_peak_hold_ms, rx_capacity * _peak_decay_percentage / 100.0);
+    _peak_tx.configure(_peak_hold_ms, tx_capacity * _peak_decay_percentage / 100.0);
+    
+    if (_per_direction) {
+        os_syslog(LOG_DEBUG, "Capacity RX %u Mbps, TX %u Mbps, first level from %.1f/%.1f Mbps",
+                  rx_capacity, tx_capacity, _rx_levels.get_bound(1), _tx_levels.get_bound(1));
+    } else {
+        os_syslog(LOG_DEBUG, "Capacity %u Mbps, %zu levels, first level from %.1f Mbps",
+                  capacity_mbps, _levels.size(), _levels.get_bound(1));
+    }
 }
 
 bool led_state_manager_t::update_leds(const bandwidth_info_t& bandwidth_info) {
     if (!bandwidth_info.valid) {
-        syslog(LOG_WARNING, "Invalid bandwidth info, keeping current LED state");
+        os_syslog(LOG_WARNING, "Invalid bandwidth info, keeping current LED state");
         return false;
     }
     
-    led_state_t new_state = determine_state_from_usage(bandwidth_info.usage_percentage);
+    if (_per_direction) {
+        return update_leds_per_direction(bandwidth_info);
+    }
+    
+    // Sample time rather than the clock, so a replayed trace takes the same decisions
+    auto now = bandwidth_info.timestamp;
+    double total_mbps = bandwidth_info.total_mbps;
+    if (_peak_enabled) {
+        total_mbps = _peak_total.update(total_mbps, now);
+    }
     
-    // Only update if state changed
-    if (new_state != _current_state) {
-        syslog(LOG_INFO, "Bandwidth usage: %.1f%% (%.1f Mbps) - changing LED state from %s to %s",
-               bandwidth_info.usage_percentage, bandwidth_info.total_mbps,
-               get_state_name(_current_state), get_state_name(new_state));
+    led_state_t new_state = _levels.find(total_mbps);
+    
+    // Only update if state changed (and, in peak-hold mode, not too often)
+    if (new_state != _current_state && now - _last_update >= _min_update) {
+        os_syslog(LOG_INFO, "Bandwidth usage: %.1f%% (%.1f Mbps) - changing LED state from %s to %s",
+                  bandwidth_info.usage_percentage, bandwidth_info.total_mbps,
+                  get_state_name(_current_state), get_state_name(new_state));
         
         if (apply_led_state(new_state)) {
             _current_state = new_state;
+            _last_update = now;
             return true;
         } else {
-            syslog(LOG_ERR, "Failed to apply LED state: %s", get_state_name(new_state));
+            os_syslog(LOG_ERR, "Failed to apply LED state: %s", get_state_name(new_state));
             return false;
         }
     }
@@ -34,149 +167,381 @@ bool led_state_manager_t::update_leds(const bandwidth_info_t& bandwidth_info) {
     return true; // No change needed, but not an error
 }
 
+bool led_state_manager_t::update_leds_per_direction(const bandwidth_info_t& bandwidth_info) {
+    auto now = bandwidth_info.timestamp;
+    double rx_mbps = bandwidth_info.rx_mbps;
+    double tx_mbps = bandwidth_info.tx_mbps;
+    if (_peak_enabled) {
+        rx_mbps = _peak_rx.update(rx_mbps, now);
+        tx_mbps = _peak_tx.update(tx_mbps, now);
+    }
+    
+    led_state_t rx_state = _rx_levels.find(rx_mbps);
+    led_state_t tx_state = _tx_levels.find(tx_mbps);
+    
+    if ((rx_state == _rx_state && tx_state == _tx_state) || now - _last_update < _min_update) {
+        return true;
+    }
+    
+    os_syslog(LOG_INFO, "Bandwidth RX %.1f Mbps, TX %.1f Mbps - changing LED state to RX %s, TX %s",
+              bandwidth_info.rx_mbps, bandwidth_info.tx_mbps,
+              _rx_levels.get(rx_state).name.c_str(), _tx_levels.get(tx_state).name.c_str());
+    
+    led_frame_t frame;
+    build_base_frame(frame);
+    set_network_led(frame, _rx_led, _rx_levels, rx_state);
+    set_network_led(frame, _tx_led, _tx_levels, tx_state);
+    
+    if (!apply_frame(frame)) {
+        os_syslog(LOG_ERR, "Failed to apply per-direction LED state");
+        return false;
+    }
+    
+    _rx_state = rx_state;
+    _tx_state = tx_state;
+    _current_state = rx_state > tx_state ? rx_state : tx_state;
+    _last_update = now;
+    return true;
+}
+
 bool led_state_manager_t::set_state(led_state_t state) {
+    if (state >= _levels.size()) {
+        return false;
+    }
     if (apply_led_state(state)) {
         _current_state = state;
+        _rx_state = _tx_state = state;
         return true;
     }
     return false;
 }
 
-led_state_t led_state_manager_t::determine_state_from_usage(double usage_percentage) {
-    if (usage_percentage < _low_threshold) {
-        return led_state_t::UTILIZATION_OFF;
-    } else if (usage_percentage < _medium_threshold) {
-        return led_state_t::NETDEV_GREEN;
-    } else if (usage_percentage < _high_threshold) {
-        return led_state_t::NETDEV_DISK1_BLUE;
+
+bool led_state_manager_t::apply_led_state(led_state_t state) {
+    bool applied;
+    
+    if (_per_direction) {
+        // Both directions show the same level
+        led_frame_t frame;
+        build_base_frame(frame);
+        set_network_led(frame, _rx_led, _rx_levels, state);
+        set_network_led(frame, _tx_led, _tx_levels, state);
+        applied = apply_frame(frame);
     } else {
-        return led_state_t::ALL_UTILIZATION_RED;
+        applied = apply_frame(_level_frames[state]);
+    }
+    
+    if (!applied) {
+        os_syslog(LOG_ERR, "Failed to apply LED state %s", get_state_name(state));
+        return false;
     }
+    
+    os_syslog(LOG_DEBUG, "Successfully applied LED state %s", get_state_name(state));
+    return true;
 }
 
-bool led_state_manager_t::apply_led_state(led_state_t state) {
-    // Get target LED states for the new state
-    bool target_netdev_on, target_disk1_on, target_disk2_on;
-    rgb_color_t target_color;
-    get_target_led_states(state, target_netdev_on, target_disk1_on, target_disk2_on, target_color);
-    
-    syslog(LOG_DEBUG, "Applying LED state %s: netdev=%s, disk1=%s, disk2=%s, color=(%d,%d,%d)",
-           get_state_name(state),
-           target_netdev_on ? "on" : "off",
-           target_disk1_on ? "on" : "off",
-           target_disk2_on ? "on" : "off",
-           target_color.r, target_color.g, target_color.b);
-    
-    // Always ensure power LED is on and white
-    int result = _led_controller.set_led_state(LEDCTL_LED_POWER, true, COLOR_WHITE, _brightness);
-    if (result != 0) {
-        syslog(LOG_ERR, "Failed to set power LED");
-        return false;
+void led_state_manager_t::build_base_frame(led_frame_t& frame) {
+    for (auto& target : frame) {
+        target = led_target_t{};
     }
-    usleep(100000); // 100ms delay after power LED
     
-    // Apply utilization LEDs with incremental changes
-    bool success = true;
+    // Power LED is always on and white, utilization LEDs default to off
+    frame[(size_t)LEDCTL_LED_POWER] = make_led_target(true, COLOR_WHITE, _brightness);
+    frame[(size_t)LEDCTL_LED_NETDEV] = make_led_target(false, COLOR_OFF, _brightness);
+    frame[(size_t)LEDCTL_LED_DISK1] = make_led_target(false, COLOR_OFF, _brightness);
+    frame[(size_t)LEDCTL_LED_DISK2] = make_led_target(false, COLOR_OFF, _brightness);
     
-    // Handle netdev LED
-    if (target_netdev_on) {
-        result = _led_controller.set_led_state(LEDCTL_LED_NETDEV, true, target_color, _brightness);
-        if (result != 0) {
-            syslog(LOG_ERR, "Failed to set netdev LED");
-            success = false;
-        }
-    } else {
-        result = _led_controller.turn_off_led(LEDCTL_LED_NETDEV);
-        if (result != 0) {
-            syslog(LOG_ERR, "Failed to turn off netdev LED");
-            success = false;
+    // Disk LEDs are driven separately in disk mode
+    for (size_t i = 0; i < frame.size(); ++i) {
+        if (is_disk_led((led_controller_t::led_type_t)i)) {
+            frame[i].managed = false;
         }
     }
-    usleep(100000); // 100ms delay between LEDs
+}
+
+bool led_state_manager_t::is_disk_led(led_controller_t::led_type_t id) const {
+    size_t index = (size_t)id;
+    size_t first = (size_t)LEDCTL_LED_DISK1;
+    return _disks_enabled && index >= first && index < first + _disk_count;
+}
+
+void led_state_manager_t::set_network_led(led_frame_t& frame, led_controller_t::led_type_t id,
+                                          const level_table_t& levels, led_state_t state) {
+    if (is_disk_led(id)) {
+        return;
+    }
+    frame[(size_t)id] = levels.get_target(state);
+}
+
+bool led_state_manager_t::update_disk_leds(const std::vector<disk_usage_t>& disk_usage) {
+    if (!_disks_enabled) {
+        return true;
+    }
     
-    // Handle disk1 LED
-    if (target_disk1_on) {
-        result = _led_controller.set_led_state(LEDCTL_LED_DISK1, true, target_color, _brightness);
-        if (result != 0) {
-            syslog(LOG_ERR, "Failed to set disk1 LED");
-            success = false;
+    led_frame_t frame;
+    for (auto& target : frame) {
+        target = led_target_t{};
+    }
+    
+    bool changed = false;
+    std::array<led_state_t, LEDCTL_LED_COUNT> new_states = _disk_states;
+    
+    for (size_t i = 0; i < _disk_count && i < disk_usage.size(); ++i) {
+        const disk_usage_t& usage = disk_usage[i];
+        double total_mbs = usage.read_mbs + usage.write_mbs;
+        led_state_t state = usage.present ? _disk_levels.find(total_mbs) : 0;
+        
+        size_t index = (size_t)LEDCTL_LED_DISK1 + i;
+        frame[index] = _disk_levels.get_target(state);
+        
+        // The first update (or a retry after a failed one) always writes
+        if (state != _disk_states[i] || !_disk_states_applied) {
+            os_syslog(LOG_INFO, "Disk %zu: R=%.1f MB/s, W=%.1f MB/s - changing LED state from %s to %s",
+                      i + 1, usage.read_mbs, usage.write_mbs,
+                      get_state_name(_disk_states[i]), get_state_name(state));
+            new_states[i] = state;
+            changed = true;
         }
+    }
+    
+    if (!changed) {
+        return true;
+    }
+    
+    if (!apply_frame(frame)) {
+        os_syslog(LOG_ERR, "Failed to apply disk LED state");
+        _disk_states_applied = false;
+        return false;
+    }
+    
+    _disk_states = new_states;
+    _disk_states_applied = true;
+    return true;
+}
+
+bool led_state_manager_t::update_alerts(const bandwidth_info_t& bandwidth_info) {
+    if (!bandwidth_info.valid || (_alert_drop_rate <= 0 && _alert_error_rate <= 0)) {
+        return true;
+    }
+    
+    double drops = bandwidth_info.rx_drops_ps + bandwidth_info.tx_drops_ps;
+    double errors = bandwidth_info.rx_errors_ps + bandwidth_info.tx_errors_ps + bandwidth_info.fifo_ps;
+    bool exceeded = (_alert_drop_rate > 0 && drops > _alert_drop_rate) ||
+                    (_alert_error_rate > 0 && errors > _alert_error_rate);
+    
+    auto now = bandwidth_info.timestamp;
+    bool active = _alert_active;
+    if (exceeded) {
+        _alert_until = now + _alert_hold;
+        active = true;
+    } else if (_alert_active && now >= _alert_until) {
+        active = false;
+    }
+    
+    if (active == _alert_active) {
+        return true;
+    }
+    
+    if (active) {
+        os_syslog(LOG_WARNING, "Packet loss alert: %.1f drops/s, %.1f errors/s", drops, errors);
+    } else {
+        os_syslog(LOG_INFO, "Packet loss alert cleared");
+    }
+    
+    _alert_active = active;
+    if (active) {
+        _compositor.set_layer_led(led_layer_t::drop_alert, _alert_led, _alert_target);
     } else {
-        result = _led_controller.turn_off_led(LEDCTL_LED_DISK1);
-        if (result != 0) {
-            syslog(LOG_ERR, "Failed to turn off disk1 LED");
-            success = false;
+        _compositor.clear_layer(led_layer_t::drop_alert);
+    }
+    return _compositor.commit();
+}
+
+bool led_state_manager_t::set_link_state(bool up) {
+    if (up == _link_up) {
+        return true;
+    }
+    _link_up = up;
+    
+    if (!_link_down_alert) {
+        return true;
+    }
+    
+    if (up) {
+        os_syslog(LOG_INFO, "Link is up");
+        _compositor.clear_layer(led_layer_t::link_down);
+    } else {
+        // Slow red blink on netdev (or the RX LED in per-direction mode)
+        os_syslog(LOG_WARNING, "Link is down");
+        led_controller_t::led_type_t id = _per_direction ? _rx_led : LEDCTL_LED_NETDEV;
+        _compositor.set_layer_led(led_layer_t::link_down, id,
+                                  make_led_target(true, COLOR_RED, _brightness, led_effect_t::blink, 1000, 1000));
+    }
+    return _compositor.commit();
+}
+
+bool led_state_manager_t::notify(led_controller_t::led_type_t id, const led_target_t& target, uint32_t seconds) {
+    size_t index = (size_t)id;
+    _notification_active[index] = true;
+    _notification_until[index] = seconds ?
+        std::chrono::steady_clock::now() + std::chrono::seconds(seconds) :
+        std::chrono::steady_clock::time_point::max();
+    
+    _compositor.set_layer_led(led_layer_t::notification, id, target);
+    return _compositor.commit();
+}
+
+bool led_state_manager_t::clear_notifications() {
+    _notification_active.fill(false);
+    _compositor.clear_layer(led_layer_t::notification);
+    return _compositor.commit();
+}
+
+bool led_state_manager_t::load_notifications(const std::string& path) {
+    _notification_active.fill(false);
+    _compositor.clear_layer(led_layer_t::notification);
+    
+    FILE* file = fopen(path.c_str(), "re");
+    if (!file) {
+        os_syslog(LOG_INFO, "No notifications file %s, notifications cleared", path.c_str());
+        return _compositor.commit();
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\n")] = '\0';
+        char name[32], color_str[32] = "", effect_str[16] = "steady";
+        uint32_t seconds = 0;
+        if (sscanf(line, "%31s %31s %15s %u", name, color_str, effect_str, &seconds) < 1 || name[0] == '#') {
+            continue;
         }
+        
+        led_controller_t::led_type_t id;
+        unsigned int r, g, b;
+        if (!led_controller_t::parse_led_name(name, id) ||
+            sscanf(color_str, "%u,%u,%u", &r, &g, &b) != 3 || r > 255 || g > 255 || b > 255) {
+            os_syslog(LOG_WARNING, "Invalid notification: %s", line);
+            continue;
+        }
+        
+        led_effect_t effect = led_effect_t::steady;
+        if (strcmp(effect_str, "blink") == 0) {
+            effect = led_effect_t::blink;
+        } else if (strcmp(effect_str, "breath") == 0) {
+            effect = led_effect_t::breath;
+        }
+        
+        rgb_color_t color = {(uint8_t)r, (uint8_t)g, (uint8_t)b};
+        size_t index = (size_t)id;
+        _notification_active[index] = true;
+        _notification_until[index] = seconds ? now + std::chrono::seconds(seconds) :
+                                               std::chrono::steady_clock::time_point::max();
+        _compositor.set_layer_led(led_layer_t::notification, id,
+                                  make_led_target(true, color, _brightness, effect, 500, 500));
+        
+        os_syslog(LOG_INFO, "Notification on %s: (%u,%u,%u) %s for %s", name, r, g, b, effect_str,
+                  seconds ? (std::to_string(seconds) + "s").c_str() : "ever");
     }
-    usleep(100000); // 100ms delay between LEDs
+    fclose(file);
     
-    // Handle disk2 LED
-    if (target_disk2_on) {
-        result = _led_controller.set_led_state(LEDCTL_LED_DISK2, true, target_color, _brightness);
-        if (result != 0) {
-            syslog(LOG_ERR, "Failed to set disk2 LED");
-            success = false;
+    return _compositor.commit();
+}
+
+bool led_state_manager_t::set_maintenance(bool enabled) {
+    if (enabled == _maintenance) {
+        return true;
+    }
+    _maintenance = enabled;
+    
+    if (enabled) {
+        // Every LED goes dark, including ones a lower layer only claims
+        // later on, and the power LED breathes
+        for (size_t i = 0; i < LEDCTL_LED_COUNT; ++i) {
+            _compositor.set_layer_led(led_layer_t::maintenance, (led_controller_t::led_type_t)i,
+                                      make_led_target(false, COLOR_OFF, _brightness));
         }
+        _compositor.set_layer_led(led_layer_t::maintenance, LEDCTL_LED_POWER,
+                                  make_led_target(true, COLOR_WHITE, _brightness, led_effect_t::breath, 1500, 1500));
+        os_syslog(LOG_INFO, "Maintenance mode enabled");
     } else {
-        result = _led_controller.turn_off_led(LEDCTL_LED_DISK2);
-        if (result != 0) {
-            syslog(LOG_ERR, "Failed to turn off disk2 LED");
-            success = false;
+        _compositor.clear_layer(led_layer_t::maintenance);
+        os_syslog(LOG_INFO, "Maintenance mode disabled");
+    }
+    
+    return _compositor.commit();
+}
+
+bool led_state_manager_t::update_overlays() {
+    auto now = std::chrono::steady_clock::now();
+    bool expired = false;
+    
+    for (size_t i = 0; i < _notification_active.size(); ++i) {
+        if (_notification_active[i] && now >= _notification_until[i]) {
+            _notification_active[i] = false;
+            _compositor.release_layer_led(led_layer_t::notification, (led_controller_t::led_type_t)i);
+            os_syslog(LOG_INFO, "Notification on %s expired", led_controller_t::get_led_name((led_controller_t::led_type_t)i));
+            expired = true;
         }
     }
     
-    if (!success) {
-        syslog(LOG_ERR, "Failed to apply LED state %s", get_state_name(state));
-        return false;
+    // A tool that dies gives its lease back, so the file is polled rather than trusted
+    bool yield_changed = false;
+    if (_lease.is_enabled() && now - _lease_checked >= std::chrono::seconds(1)) {
+        _lease_checked = now;
+        uint32_t leased = _lease.read();
+        if (leased != _compositor.get_yielded()) {
+            char names[128];
+            size_t used = 0;
+            names[0] = '\0';
+            for (size_t i = 0; i < LEDCTL_LED_COUNT; ++i) {
+                if (leased & (1u << i)) {
+                    used += snprintf(names + used, sizeof(names) - used, "%s%s", used ? ", " : "",
+                                     led_controller_t::get_led_name((led_controller_t::led_type_t)i));
+                }
+            }
+            if (leased) {
+                os_syslog(LOG_INFO, "Yielding %s to the holder of the lease", names);
+            } else {
+                os_syslog(LOG_INFO, "Lease released, driving all LEDs again");
+            }
+            _compositor.set_yielded(leased);
+            yield_changed = true;
+        }
     }
     
-    syslog(LOG_DEBUG, "Successfully applied LED state %s", get_state_name(state));
-    return true;
+    // Overlay flags are set before their commit, so a frame the bus lock put
+    // off would otherwise wait for the next unrelated change
+    bool retry = false;
+    if (_compositor.is_pending() && now - _commit_retried >= std::chrono::seconds(1)) {
+        _commit_retried = now;
+        retry = true;
+    }
+    
+    return expired || yield_changed || retry ? _compositor.commit() : true;
 }
 
-void led_state_manager_t::get_target_led_states(led_state_t state, bool& netdev_on, bool& disk1_on, bool& disk2_on, rgb_color_t& color) {
-    switch (state) {
-        case led_state_t::UTILIZATION_OFF:
-            netdev_on = false;
-            disk1_on = false;
-            disk2_on = false;
-            color = COLOR_OFF;
-            break;
-            
-        case led_state_t::NETDEV_GREEN:
-            netdev_on = true;
-            disk1_on = false;
-            disk2_on = false;
-            color = COLOR_GREEN;
-            break;
-            
-        case led_state_t::NETDEV_DISK1_BLUE:
-            netdev_on = true;
-            disk1_on = true;
-            disk2_on = false;
-            color = COLOR_BLUE;
-            break;
-            
-        case led_state_t::ALL_UTILIZATION_RED:
-            netdev_on = true;
-            disk1_on = true;
-            disk2_on = true;
-            color = COLOR_RED;
-            break;
-    }
-}
-
-const char* led_state_manager_t::get_state_name(led_state_t state) {
-    switch (state) {
-        case led_state_t::UTILIZATION_OFF:
-            return "UTILIZATION_OFF";
-        case led_state_t::NETDEV_GREEN:
-            return "NETDEV_GREEN";
-        case led_state_t::NETDEV_DISK1_BLUE:
-            return "NETDEV_DISK1_BLUE";
-        case led_state_t::ALL_UTILIZATION_RED:
-            return "ALL_UTILIZATION_RED";
-        default:
-            return "UNKNOWN";
-    }
-}
\ No newline at end of file
+bool led_state_manager_t::reconcile(std::chrono::steady_clock::time_point now) {
+    if (_readback_interval.count() == 0) {
+        return true;
+    }
+    if (_readback_due == std::chrono::steady_clock::time_point()) {
+        // Whatever was written at startup is fresh, the first read can wait
+        _readback_due = now + _readback_interval;
+    }
+    if (now < _readback_due) {
+        return true;
+    }
+    // Not made up for after a stall, the budget is a ceiling
+    _readback_due = now + _readback_interval;
+    return _compositor.reconcile_next();
+}
+
+bool led_state_manager_t::apply_frame(const led_frame_t& frame) {
+    _compositor.update_layer(led_layer_t::base, frame);
+    return _compositor.commit();
+}
+
+const char* led_state_manager_t::get_state_name(led_state_t state) const {
+    return state < _levels.size() ? _levels.get(state).name.c_str() : "UNKNOWN";
+}
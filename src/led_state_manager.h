@@ -2,46 +2,146 @@
 #define __LEDCTL_LED_STATE_MANAGER_H__
 
 #include "led_controller.h"
+#include "led_compositor.h"
+#include "level_table.h"
+#include "peak_meter.h"
 #include "bandwidth_monitor.h"
 #include "config_parser.h"
-
-enum class led_state_t {
-    UTILIZATION_OFF,        // idle: netdev, disk1, disk2 off (power always on)
-    NETDEV_GREEN,          // low: netdev green
-    NETDEV_DISK1_BLUE,     // medium: netdev and disk1 blue
-    ALL_UTILIZATION_RED    // high: netdev, disk1, disk2 red
-};
+#include "disk_monitor.h"
 
 class led_state_manager_t {
 private:
-    led_controller_t& _led_controller;
+    led_compositor_t _compositor;
     led_state_t _current_state;
     uint8_t _brightness;
-    uint8_t _low_threshold;
-    uint8_t _medium_threshold;
-    uint8_t _high_threshold;
+    
+    // Level table with bounds in Mbps for the current capacity, and the
+    // precomputed frame of every level for combined mode
+    level_table_t _levels;
+    std::vector<led_frame_t> _level_frames;
+    
+    // Per-direction mode: RX and TX get their own LED, capacity and thresholds
+    bool _per_direction;
+    led_controller_t::led_type_t _rx_led;
+    led_controller_t::led_type_t _tx_led;
+    uint32_t _rx_capacity_mbps;       // 0 = link speed
+    uint32_t _tx_capacity_mbps;       // 0 = link speed
+    level_table_t _rx_levels;
+    level_table_t _tx_levels;
+    led_state_t _rx_state;
+    led_state_t _tx_state;
+    
+    // Peak-hold mode: levels follow the ballistics of each value instead of
+    // the raw samples, and level changes are at least _min_update apart
+    bool _peak_enabled;
+    uint32_t _peak_hold_ms;
+    uint32_t _peak_decay_percentage;
+    peak_meter_t _peak_total;
+    peak_meter_t _peak_rx;
+    peak_meter_t _peak_tx;
+    std::chrono::milliseconds _min_update;
+    std::chrono::steady_clock::time_point _last_update;
+    
+    // Disk mode: disk1..diskN show the throughput of their own bay
+    bool _disks_enabled;
+    size_t _disk_count;
+    level_table_t _disk_levels;
+    std::array<led_state_t, LEDCTL_LED_COUNT> _disk_states;
+    bool _disk_states_applied;
+    
+    // Drop alert layer: replaces one LED (the power LED by default) while drop
+    // or error rates are above their limits
+    double _alert_drop_rate;
+    double _alert_error_rate;
+    led_controller_t::led_type_t _alert_led;
+    led_target_t _alert_target;
+    std::chrono::milliseconds _alert_hold;
+    std::chrono::steady_clock::time_point _alert_until;
+    bool _alert_active;
+    
+    // Link down layer
+    bool _link_down_alert;
+    bool _link_up;
+    
+    // Notification layer, each LED expires on its own
+    std::array<std::chrono::steady_clock::time_point, LEDCTL_LED_COUNT> _notification_until;
+    std::array<bool, LEDCTL_LED_COUNT> _notification_active;
+    
+    bool _maintenance;
+    
+    // Yield mode: LEDs leased by another tool are left to it
+    led_lease_t _lease;
+    std::chrono::steady_clock::time_point _lease_checked;
+    
+    // Retries of a commit that failed or found the bus taken
+    std::chrono::steady_clock::time_point _commit_retried;
+    
+    // Readback: one LED every _readback_interval keeps the reads within the budget
+    std::chrono::steady_clock::duration _readback_interval;   // zero = off
+    std::chrono::steady_clock::time_point _readback_due;
     
     // Core logic methods
-    led_state_t determine_state_from_usage(double usage_percentage);
     bool apply_led_state(led_state_t state);
+    bool apply_frame(const led_frame_t& frame);
+    bool update_leds_per_direction(const bandwidth_info_t& bandwidth_info);
     
     // Helper methods for LED control
-    void get_target_led_states(led_state_t state, bool& netdev_on, bool& disk1_on, bool& disk2_on, rgb_color_t& color);
-    
+    void compile_levels();
+    void build_base_frame(led_frame_t& frame);
+    bool is_disk_led(led_controller_t::led_type_t id) const;
+    void set_network_led(led_frame_t& frame, led_controller_t::led_type_t id,
+                         const level_table_t& levels, led_state_t state);
+
 public:
     led_state_manager_t(led_controller_t& led_controller, const ledctl_config_t& config);
     
+    // Recompute the threshold tables for a new link capacity (total and per direction)
+    void set_capacity_mbps(uint32_t capacity_mbps, uint32_t direction_capacity_mbps);
+    
     // Update LEDs based on bandwidth usage
     bool update_leds(const bandwidth_info_t& bandwidth_info);
     
+    // Update disk LEDs based on per-bay throughput (disk mode only)
+    bool update_disk_leds(const std::vector<disk_usage_t>& disk_usage);
+    
+    // Show or clear the alert overlay based on drop and error rates
+    bool update_alerts(const bandwidth_info_t& bandwidth_info);
+    
+    // Show or clear the link down layer
+    bool set_link_state(bool up);
+    
+    // Show a notification on an LED, seconds = 0 keeps it until cleared
+    bool notify(led_controller_t::led_type_t id, const led_target_t& target, uint32_t seconds);
+    bool clear_notifications();
+    
+    // Replace all notifications with the ones listed in a file, one per line:
+    //   <led> <r,g,b> [steady|blink|breath] [seconds]
+    bool load_notifications(const std::string& path);
+    
+    // Maintenance mode: power LED breathes, everything else is off
+    bool set_maintenance(bool enabled);
+    bool is_maintenance() const { return _maintenance; }
+    
+    // Expire notifications, follow the yield lease and retry a failed
+    // commit, call once per tick
+    bool update_overlays();
+    
+    // Read one LED back and repair what differs once the readback budget
+    // allows it, call once per tick
+    bool reconcile(std::chrono::steady_clock::time_point now);
+    uint64_t get_repair_count() const { return _compositor.get_repair_count(); }
+    
     // Set LEDs to specific state (for testing)
     bool set_state(led_state_t state);
     
     // Get current state
     led_state_t get_current_state() const { return _current_state; }
     
+    // Configured levels, for cycling through them in testing mode
+    const level_table_t& get_levels() const { return _levels; }
+    
     // Get state name for logging
-    static const char* get_state_name(led_state_t state);
+    const char* get_state_name(led_state_t state) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,69 @@
+#include "level_table.h"
+#include "os.h"
+#include <syslog.h>
+#include <algorithm>
+#include <limits>
+
+level_table_t::level_table_t() : _step(0) {
+    load(make_default(10, 40, 80, 255));
+}
+
+void level_table_t::load(const std::vector<led_level_t>& levels) {
+    _levels = levels;
+    std::stable_sort(_levels.begin(), _levels.end(), [](const led_level_t& a, const led_level_t& b) {
+        return a.threshold < b.threshold;
+    });
+    
+    if (_levels.empty() || _levels[0].threshold > 0) {
+        led_level_t idle = {"idle", 0, 0, COLOR_OFF, led_effect_t::steady, 0, 0, 0};
+        _levels.insert(_levels.begin(), idle);
+    }
+    
+    for (size_t i = 1; i < _levels.size(); ++i) {
+        if (_levels[i].threshold == _levels[i - 1].threshold) {
+            os_syslog(LOG_WARNING, "Levels %s and %s share the threshold %u%%, %s is never shown",
+                      _levels[i - 1].name.c_str(), _levels[i].name.c_str(), _levels[i].threshold,
+                      _levels[i - 1].name.c_str());
+        }
+    }
+    
+    if (_levels.size() > UINT8_MAX) {
+        os_syslog(LOG_WARNING, "Too many levels (%zu), only the first %u are used", _levels.size(), UINT8_MAX);
+        _levels.resize(UINT8_MAX);
+    }
+    
+    // Alone, an LED is lit for every level that lights any LED
+    _targets.clear();
+    for (const led_level_t& level : _levels) {
+        _targets.push_back(make_led_target(level.leds != 0, level.leds ? level.color : COLOR_OFF, level.brightness,
+                                           level.effect, level.t_on, level.t_off));
+    }
+    
+    size_t padded = 1;
+    while (padded < _levels.size()) {
+        padded <<= 1;
+    }
+    _bounds.assign(padded, std::numeric_limits<double>::infinity());
+    _step = padded / 2;
+    
+    set_capacity(100.0);
+}
+
+void level_table_t::set_capacity(double capacity) {
+    for (size_t i = 1; i < _levels.size(); ++i) {
+        _bounds[i - 1] = capacity * _levels[i].threshold / 100.0;
+    }
+}
+
+std::vector<led_level_t> level_table_t::make_default(uint8_t low, uint8_t medium, uint8_t high, uint8_t brightness) {
+    const uint32_t netdev = 1u << (size_t)LEDCTL_LED_NETDEV;
+    const uint32_t disk1 = 1u << (size_t)LEDCTL_LED_DISK1;
+    const uint32_t disk2 = 1u << (size_t)LEDCTL_LED_DISK2;
+    
+    return {
+        {"off", 0, 0, COLOR_OFF, led_effect_t::steady, brightness, 0, 0},
+        {"low", low, netdev, COLOR_GREEN, led_effect_t::steady, brightness, 0, 0},
+        {"medium", medium, netdev | disk1, COLOR_BLUE, led_effect_t::steady, brightness, 0, 0},
+        {"high", high, netdev | disk1 | disk2, COLOR_RED, led_effect_t::steady, brightness, 0, 0}
+    };
+}
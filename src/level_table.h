@@ -0,0 +1,63 @@
+#ifndef __LEDCTL_LEVEL_TABLE_H__
+#define __LEDCTL_LEVEL_TABLE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "led_compositor.h"
+
+// Index into a level table, 0 is the idle level
+typedef uint8_t led_state_t;
+
+// One utilization level as configured in a [level.<name>] section
+struct led_level_t {
+    std::string name;
+    uint8_t threshold;          // percent of capacity at which the level starts
+    uint32_t leds;              // bit (1 << led_type_t) for every LED lit at this level
+    rgb_color_t color;
+    led_effect_t effect;
+    uint8_t brightness;
+    uint16_t t_on, t_off;       // blink/breath timing in ms
+};
+
+// Levels sorted by threshold. The percent thresholds are turned into absolute
+// bounds for a capacity, padded with +inf to a power of two so that find()
+// is a fixed number of compares without data-dependent branches.
+class level_table_t {
+private:
+    std::vector<led_level_t> _levels;   // sorted, [0] is the idle level
+    std::vector<led_target_t> _targets; // an LED showing each level on its own
+    std::vector<double> _bounds;        // start of level i + 1, then +inf
+    size_t _step;                       // _bounds.size() / 2
+
+public:
+    level_table_t();
+    
+    // Sort the levels, an idle level (no LEDs) is added if none starts at 0%
+    void load(const std::vector<led_level_t>& levels);
+    
+    // Compute the bounds for a capacity (Mbps or MB/s, whatever find() is given)
+    void set_capacity(double capacity);
+    
+    // Highest level whose bound is <= value
+    led_state_t find(double value) const {
+        size_t index = 0;
+        for (size_t step = _step; step > 0; step >>= 1) {
+            index += _bounds[index + step - 1] <= value ? step : 0;
+        }
+        return (led_state_t)index;
+    }
+    
+    size_t size() const { return _levels.size(); }
+    const led_level_t& get(led_state_t state) const { return _levels[state]; }
+    const led_target_t& get_target(led_state_t state) const { return _targets[state]; }
+    
+    // Where a level starts for the current capacity
+    double get_bound(led_state_t state) const { return state ? _bounds[state - 1] : 0.0; }
+    
+    // The built-in off / green / blue / red table on netdev, disk1 and disk2
+    static std::vector<led_level_t> make_default(uint8_t low, uint8_t medium, uint8_t high, uint8_t brightness);
+};
+
+#endif
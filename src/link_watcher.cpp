@@ -0,0 +1,108 @@
+#include "link_watcher.h"
+#include "sys_root.h"
+#include "os.h"
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <cerrno>
+#include <cstring>
+
+link_watcher_t::~link_watcher_t() {
+    if (_fd >= 0) os_close(_fd);
+}
+
+bool link_watcher_t::start(const std::string& interface) {
+    _interface = interface;
+    _buffer.resize(NETLINK_BUFFER_SIZE);
+    _ifindex = if_nametoindex(interface.c_str());
+    if (_ifindex == 0) {
+        os_syslog(LOG_WARNING, "Cannot resolve ifindex of %s, link events disabled", interface.c_str());
+        return false;
+    }
+
+    _fd = os_socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (_fd < 0) {
+        os_syslog(LOG_WARNING, "Failed to open netlink socket: %s", strerror(errno));
+        return false;
+    }
+
+    sockaddr_nl addr { };
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK;
+
+    if (os_bind(_fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        os_syslog(LOG_WARNING, "Failed to bind netlink socket: %s", strerror(errno));
+        os_close(_fd);
+        _fd = -1;
+        return false;
+    }
+
+    // Initial carrier state, later kept up to date from IFF_RUNNING
+    uint64_t value;
+    if (read_uint64_file(sys_path("/sys/class/net/" + interface + "/carrier"), value)) {
+        _link_up = value != 0;
+    }
+
+    os_syslog(LOG_DEBUG, "Listening for link events on %s (ifindex %d)", interface.c_str(), _ifindex);
+    return true;
+}
+
+bool link_watcher_t::process_events() {
+    if (_fd < 0) return false;
+
+    bool matched = false;
+    char* buffer = _buffer.data();
+
+    while (true) {
+        // MSG_TRUNC returns the full length, so a cut off message is noticed
+        int len = os_recv(_fd, buffer, _buffer.size(), MSG_TRUNC);
+        if (len < 0) {
+            // ENOBUFS means we lost notifications, assume one of them was ours
+            if (errno == ENOBUFS) {
+                matched = true;
+                continue;
+            }
+            break;
+        }
+        if (len > (int)_buffer.size()) {
+            matched = true;
+            len = (int)_buffer.size();
+        }
+
+        for (nlmsghdr* nh = (nlmsghdr*)buffer; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_type != RTM_NEWLINK && nh->nlmsg_type != RTM_DELLINK) {
+                continue;
+            }
+
+            const ifinfomsg* ifi = (const ifinfomsg*)NLMSG_DATA(nh);
+            if (ifi->ifi_index != _ifindex) {
+                // A driver reload or a bond/VLAN rebuild brings the interface back under a new index
+                if (nh->nlmsg_type != RTM_NEWLINK || !has_name(nh)) {
+                    continue;
+                }
+                os_syslog(LOG_INFO, "%s is back as ifindex %d (was %d)", _interface.c_str(), ifi->ifi_index, _ifindex);
+                _ifindex = ifi->ifi_index;
+            }
+            matched = true;
+            _link_up = nh->nlmsg_type == RTM_NEWLINK && (ifi->ifi_flags & IFF_RUNNING);
+        }
+    }
+
+    return matched;
+}
+
+bool link_watcher_t::has_name(const nlmsghdr* nh) const {
+    const ifinfomsg* ifi = (const ifinfomsg*)NLMSG_DATA(nh);
+    int len = IFLA_PAYLOAD(nh);
+    for (const rtattr* rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+        if (rta->rta_type == IFLA_IFNAME) {
+            const char* name = (const char*)RTA_DATA(rta);
+            return strnlen(name, RTA_PAYLOAD(rta)) == _interface.size() &&
+                   memcmp(name, _interface.data(), _interface.size()) == 0;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,36 @@
+#ifndef __LEDCTL_LINK_WATCHER_H__
+#define __LEDCTL_LINK_WATCHER_H__
+
+#include <string>
+#include <vector>
+
+// Listens for RTNLGRP_LINK netlink notifications for a single interface
+class link_watcher_t {
+private:
+    int _fd;
+    std::string _interface;
+    int _ifindex;         // followed when the interface is re-created under its name
+    bool _link_up;
+    std::vector<char> _buffer;
+
+    // Whether a link message carries our interface's name
+    bool has_name(const struct nlmsghdr* nh) const;
+
+public:
+    link_watcher_t() : _fd(-1), _ifindex(0), _link_up(true) {}
+    ~link_watcher_t();
+
+    // Open the netlink socket and subscribe to link notifications
+    bool start(const std::string& interface);
+
+    // Pollable descriptor, -1 if the watcher is not running
+    int get_fd() const { return _fd; }
+
+    // Drain pending notifications, returns true if any of them concerned our interface
+    bool process_events();
+
+    // Carrier state as of the last processed notification
+    bool is_link_up() const { return _link_up; }
+};
+
+#endif
@@ -1,34 +1,103 @@
-#include <iostream>
 #include <chrono>
 #include <thread>
 #include <signal.h>
 #include <syslog.h>
 #include <unistd.h>
 #include <getopt.h>
-#include <fstream>
 #include <string>
+#include <cstdio>
 #include <cstring>
+#include <algorithm>
+#include <memory>
 #include <dirent.h>
 
 #include "led_controller.h"
 #include "bandwidth_monitor.h"
 #include "config_parser.h"
 #include "led_state_manager.h"
+#include "adaptive_scheduler.h"
+#include "link_watcher.h"
+#include "disk_monitor.h"
+#include "metric_scheduler.h"
+#include "metric_sources.h"
+#include "history_archive.h"
+#include "traffic_totals.h"
+#include "monitor_loop.h"
+#include "counter_trace.h"
+#include "i2c_capture.h"
+#include "counter_generator.h"
+#include "sys_root.h"
+#include "os.h"
+
+// Idle, low, medium and high with the default thresholds on a 1 Gbps link
+#define DEFAULT_TRAFFIC_PROFILE "0:0:5,200:100:5,600:300:5,900:800:5"
+#define GENERATOR_PERIOD_MS 50
+
+// Shortest span the first rate is computed over, for a bus (the mock one)
+// that writes the initial frame faster than this
+#define FIRST_SAMPLE_MIN_MS 100
 
 // Global flag for graceful shutdown
 volatile sig_atomic_t g_running = 1;
 
+// Set by SIGUSR1 (toggle maintenance mode) and SIGUSR2 (reload notifications)
+volatile sig_atomic_t g_toggle_maintenance = 0;
+volatile sig_atomic_t g_notify_pending = 0;
+
 void signal_handler(int signal) {
-    syslog(LOG_INFO, "Received signal %d, shutting down gracefully", signal);
+    os_syslog(LOG_INFO, "Received signal %d, shutting down gracefully", signal);
     g_running = 0;
 }
 
+void overlay_signal_handler(int signal) {
+    if (signal == SIGUSR1) {
+        g_toggle_maintenance = 1;
+    } else {
+        g_notify_pending = 1;
+    }
+}
+
 void setup_signal_handlers() {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGHUP, signal_handler);
+    signal(SIGUSR1, overlay_signal_handler);
+    signal(SIGUSR2, overlay_signal_handler);
 }
 
+// Time spent in each startup phase, logged as one line once the first
+// measured frame is on the LEDs
+class startup_timer_t {
+private:
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _last;
+    std::string _phases;
+
+public:
+    startup_timer_t() : _start(std::chrono::steady_clock::now()), _last(_start) {}
+    
+    static double ms_since(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+    
+    // A phase that ran on its own since the previous mark
+    void mark(const char* phase) {
+        add(phase, ms_since(_last));
+        _last = std::chrono::steady_clock::now();
+    }
+    
+    // A phase timed by the caller, e.g. one of several running side by side
+    void add(const char* phase, double ms) {
+        char item[64];
+        snprintf(item, sizeof(item), "%s%s %.1f ms", _phases.empty() ? "" : ", ", phase, ms);
+        _phases += item;
+    }
+    
+    void log(const char* milestone) {
+        os_syslog(LOG_INFO, "Startup: %.1f ms to %s (%s)", ms_since(_start), milestone, _phases.c_str());
+    }
+};
+
 bool is_already_running(bool debug = false) {
     // Get current process ID
     pid_t current_pid = getpid();
@@ -54,23 +123,17 @@ bool is_already_running(bool debug = false) {
         }
         
         // First check the comm file (process name)
-        std::string comm_path = "/proc/" + std::string(entry->d_name) + "/comm";
-        std::ifstream comm_file(comm_path);
-        
-        if (comm_file.is_open()) {
-            std::string comm;
-            std::getline(comm_file, comm);
-            comm_file.close();
-            
-            // Remove any trailing newline
-            if (!comm.empty() && comm.back() == '\n') {
-                comm.pop_back();
-            }
+        char path[sizeof(entry->d_name) + 16];
+        char buf[256];
+        snprintf(path, sizeof(path), "/proc/%s/comm", entry->d_name);
+        if (read_small_file(path, buf, sizeof(buf))) {
+            // Remove the trailing newline
+            buf[strcspn(buf, "\n")] = '\0';
             
             // Check if this process has our exact name
-            if (comm == target_name) {
+            if (target_name == buf) {
                 if (debug) {
-                    std::cerr << "Found running instance via comm: PID " << pid << " (" << comm << ")" << std::endl;
+                    fprintf(stderr, "Found running instance via comm: PID %d (%s)\n", (int)pid, buf);
                 }
                 closedir(proc_dir);
                 return true; // Found another instance
@@ -78,28 +141,16 @@ bool is_already_running(bool debug = false) {
         }
         
         // Also check cmdline as fallback (for cases where comm is truncated)
-        std::string cmdline_path = "/proc/" + std::string(entry->d_name) + "/cmdline";
-        std::ifstream cmdline_file(cmdline_path);
-        
-        if (cmdline_file.is_open()) {
-            std::string cmdline;
-            std::getline(cmdline_file, cmdline);
-            cmdline_file.close();
-            
-            // cmdline uses null bytes as separators, get first argument (executable path)
-            size_t first_null = cmdline.find('\0');
-            std::string executable = (first_null != std::string::npos) ?
-                                   cmdline.substr(0, first_null) : cmdline;
-            
-            // Extract just the filename from the path
-            size_t last_slash = executable.find_last_of('/');
-            std::string exe_name = (last_slash != std::string::npos) ?
-                                 executable.substr(last_slash + 1) : executable;
+        snprintf(path, sizeof(path), "/proc/%s/cmdline", entry->d_name);
+        if (read_small_file(path, buf, sizeof(buf))) {
+            // cmdline uses null bytes as separators, the first argument is the executable path
+            const char* slash = strrchr(buf, '/');
+            const char* exe_name = slash ? slash + 1 : buf;
             
             // Check if the executable name matches exactly
-            if (exe_name == target_name) {
+            if (target_name == exe_name) {
                 if (debug) {
-                    std::cerr << "Found running instance via cmdline: PID " << pid << " (" << exe_name << ")" << std::endl;
+                    fprintf(stderr, "Found running instance via cmdline: PID %d (%s)\n", (int)pid, exe_name);
                 }
                 closedir(proc_dir);
                 return true; // Found another instance
@@ -135,60 +186,72 @@ void setup_logging(const std::string& log_level, bool console_mode = false) {
 }
 
 void print_usage(const char* program_name) {
-    std::cout << "Usage: " << program_name << " [OPTIONS]\n";
-    std::cout << "\nOptions:\n";
-    std::cout << "  -t, --test     Run in testing mode (cycles through bandwidth states)\n";
-    std::cout << "  -h, --help     Show this help message\n";
-    std::cout << "  -v, --version  Show version information\n";
-    std::cout << "\nConfiguration:\n";
-    std::cout << "  The service looks for configuration in:\n";
-    std::cout << "    1. ./ugreen_leds_ethutild.conf\n";
-    std::cout << "    2. /etc/ugreen_leds_ethutild.conf\n";
-    std::cout << "  If no config file is found, defaults are used.\n";
+    printf("Usage: %s [OPTIONS]\n", program_name);
+    fputs("\nOptions:\n", stdout);
+    fputs("  -t, --test     Run in testing mode (cycles through bandwidth states)\n", stdout);
+    fputs("  --history[=RES] Print the bandwidth history (RES: 1s, 1m or 1h, default 1m)\n", stdout);
+    fputs("  --totals       Print daily and monthly traffic totals\n", stdout);
+    fputs("  --record FILE  Record the interface counters to FILE while running\n", stdout);
+    fputs("  --replay FILE  Feed a recorded trace through the LED logic at full speed\n", stdout);
+    fputs("  --capture FILE Record every I2C transfer to the LED controller to FILE while running\n", stdout);
+    fputs("  --decode FILE  Print a capture as LED operations with their bus latency\n", stdout);
+    fputs("  --root DIR     Read /sys, /proc and /dev below DIR (fake trees for testing)\n", stdout);
+    fputs("  --generate[=PROFILE] Keep fake counters below --root moving at PROFILE\n", stdout);
+    fputs("                 (RX:TX:SECONDS[,...] in Mbps, played in a loop)\n", stdout);
+    fputs("  -h, --help     Show this help message\n", stdout);
+    fputs("  -v, --version  Show version information\n", stdout);
+    fputs("\nConfiguration:\n", stdout);
+    fputs("  The service looks for configuration in:\n", stdout);
+    fputs("    1. ./ugreen_leds_ethutild.conf\n", stdout);
+    fputs("    2. /etc/ugreen_leds_ethutild.conf\n", stdout);
+    fputs("  If no config file is found, defaults are used.\n", stdout);
 }
 
 void print_version() {
-    std::cout << "ugreen_leds_ethutild version 1.0.0\n";
-    std::cout << "UGREEN LEDs Ethernet Utilization Daemon for NAS bandwidth monitoring\n";
+    fputs("ugreen_leds_ethutild version 1.0.0\n", stdout);
+    fputs("UGREEN LEDs Ethernet Utilization Daemon for NAS bandwidth monitoring\n", stdout);
 }
 
 bool run_testing_mode(led_state_manager_t& state_manager) {
-    syslog(LOG_INFO, "Starting testing mode - cycling through bandwidth states");
-    std::cout << "Testing mode: cycling through bandwidth states (Ctrl+C to stop)\n";
-    
-    // Test states with corresponding usage percentages
-    struct test_state_t {
-        double usage_percentage;
-        const char* description;
-    };
+    os_syslog(LOG_INFO, "Starting testing mode - cycling through bandwidth states");
+    fputs("Testing mode: cycling through bandwidth states (Ctrl+C to stop)\n", stdout);
+    state_manager.set_capacity_mbps(DEFAULT_CAPACITY_MBPS, DEFAULT_CAPACITY_MBPS / 2);
     
-    test_state_t test_states[] = {
-        {5.0, "5% usage - Power white, utilization LEDs off"},
-        {25.0, "25% usage - Power white, NetDev green"},
-        {60.0, "60% usage - Power white, NetDev + Disk1 blue"},
-        {90.0, "90% usage - Power white, NetDev + Disk1 + Disk2 red"}
-    };
-    
-    int state_count = sizeof(test_states) / sizeof(test_states[0]);
-    int current_state = 0;
+    // Each configured level, entered at its own threshold
+    const level_table_t& levels = state_manager.get_levels();
+    size_t state_count = levels.size();
+    size_t current_state = 0;
     
     while (g_running) {
-        const auto& test_state = test_states[current_state];
-        
-        std::cout << test_state.description << std::endl;
-        syslog(LOG_INFO, "Testing: %s", test_state.description);
+        double usage_percentage = levels.get(current_state).threshold;
+        std::string description = std::to_string(levels.get(current_state).threshold) + "% usage - level " +
+                                  levels.get(current_state).name;
+        printf("%s\n", description.c_str());
+        fflush(stdout);
+        os_syslog(LOG_INFO, "Testing: %s", description.c_str());
         
-        // Create fake bandwidth info
+        // Create fake bandwidth info (state manager assumes the default capacity)
         bandwidth_info_t fake_bandwidth = {
-            .rx_mbps = test_state.usage_percentage * 10.0,  // Fake values
-            .tx_mbps = test_state.usage_percentage * 10.0,
-            .total_mbps = test_state.usage_percentage * 20.0,
-            .usage_percentage = test_state.usage_percentage,
-            .valid = true
+            .rx_mbps = usage_percentage * DEFAULT_CAPACITY_MBPS / 200.0,  // Fake values
+            .tx_mbps = usage_percentage * DEFAULT_CAPACITY_MBPS / 200.0,
+            .total_mbps = usage_percentage * DEFAULT_CAPACITY_MBPS / 100.0,
+            .usage_percentage = usage_percentage,
+            .rx_pps = 0.0,
+            .tx_pps = 0.0,
+            .rx_errors_ps = 0.0,
+            .tx_errors_ps = 0.0,
+            .rx_drops_ps = 0.0,
+            .tx_drops_ps = 0.0,
+            .fifo_ps = 0.0,
+            .rx_bytes = 0,
+            .tx_bytes = 0,
+            .timestamp = std::chrono::steady_clock::now(),
+            .valid = true,
+            .resynced = false
         };
         
         if (!state_manager.update_leds(fake_bandwidth)) {
-            syslog(LOG_ERR, "Failed to update LEDs in testing mode");
+            os_syslog(LOG_ERR, "Failed to update LEDs in testing mode");
             return false;
         }
         
@@ -198,80 +261,375 @@ bool run_testing_mode(led_state_manager_t& state_manager) {
         current_state = (current_state + 1) % state_count;
     }
     
-    syslog(LOG_INFO, "Testing mode completed");
+    os_syslog(LOG_INFO, "Testing mode completed");
+    return true;
+}
+
+bool run_history_query(const std::string& path, const std::string& resolution) {
+    int archive = history_archive_t::find_resolution(resolution);
+    if (archive < 0) {
+        fprintf(stderr, "Error: unknown history resolution %s (use 1s, 1m or 1h)\n", resolution.c_str());
+        return false;
+    }
+    
+    history_archive_t history;
+    if (!history.open_readonly(path)) {
+        fprintf(stderr, "Error: cannot read history archive %s\n", path.c_str());
+        return false;
+    }
+    
+    const history_resolution_t& info = history_archive_t::RESOLUTIONS[archive];
+    std::vector<history_row_t> rows;
+    double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    history.get_rows(archive, now, rows);
+    
+    printf("# %s, %u rows of %u s, Mbps\n", path.c_str(), info.rows, info.step_s);
+    printf("%-19s %10s %10s %10s %10s %8s\n", "time", "rx_mean", "tx_mean", "rx_peak", "tx_peak", "covered");
+    for (const history_row_t& row : rows) {
+        char time_str[32];
+        time_t time = row.time;
+        struct tm tm;
+        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime_r(&time, &tm));
+        printf("%-19s %10.2f %10.2f %10.2f %10.2f %7.0f%%\n", time_str, row.rx_mean, row.tx_mean,
+               row.rx_peak, row.tx_peak, row.seconds * 100.0 / info.step_s);
+    }
+    
+    return true;
+}
+
+bool run_totals_query(const std::string& directory, const std::string& interface) {
+    traffic_totals_t totals;
+    std::string path = traffic_totals_t::get_path(directory, interface);
+    if (access(path.c_str(), R_OK) != 0 || !totals.open(path, interface, 0)) {
+        fprintf(stderr, "Error: cannot read traffic totals %s\n", path.c_str());
+        return false;
+    }
+    
+    auto print = [](const char* title, const std::vector<traffic_total_t>& entries, bool daily) {
+        printf("%-10s %12s %12s %12s\n", title, "rx (MiB)", "tx (MiB)", "total (MiB)");
+        for (const traffic_total_t& entry : entries) {
+            char period[16];
+            if (daily) {
+                snprintf(period, sizeof(period), "%04u-%02u-%02u", entry.period / 10000,
+                         entry.period / 100 % 100, entry.period % 100);
+            } else {
+                snprintf(period, sizeof(period), "%04u-%02u", entry.period / 100, entry.period % 100);
+            }
+            double rx = entry.rx_bytes / 1048576.0;
+            double tx = entry.tx_bytes / 1048576.0;
+            printf("%-10s %12.1f %12.1f %12.1f\n", period, rx, tx, rx + tx);
+        }
+    };
+    
+    printf("# %s\n", interface.c_str());
+    print("day", totals.get_days(), true);
+    printf("\n");
+    print("month", totals.get_months(), false);
     return true;
 }
 
-bool run_normal_mode(bandwidth_monitor_t& bandwidth_monitor, led_state_manager_t& state_manager) {
-    syslog(LOG_INFO, "Starting normal monitoring mode");
-    
-    if (!bandwidth_monitor.initialize()) {
-        syslog(LOG_ERR, "Failed to initialize bandwidth monitor for interface %s",
-               bandwidth_monitor.get_interface().c_str());
-        std::cerr << "Error: Failed to initialize bandwidth monitor for interface "
-                  << bandwidth_monitor.get_interface() << std::endl;
-        std::cerr << "Please check that the network interface exists and is active." << std::endl;
+bool run_replay_mode(const std::string& path, const ledctl_config_t& config) {
+    counter_trace_t trace;
+    if (!trace.load(path)) {
+        fprintf(stderr, "Error: cannot read counter trace %s\n", path.c_str());
         return false;
     }
     
-    syslog(LOG_INFO, "Monitoring interface: %s (capacity: %u Mbps)",
-           bandwidth_monitor.get_interface().c_str(),
-           bandwidth_monitor.get_capacity_mbps());
+    const std::vector<trace_record_t>& records = trace.get_records();
+    if (records.size() < 2) {
+        fprintf(stderr, "Error: %s holds fewer than two samples\n", path.c_str());
+        return false;
+    }
     
-    // Wait 1 second after initialization to ensure first measurement is valid
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // Per-transition syslog lines would dominate the run, they are printed below instead
+    if (config.log_level != "debug") {
+        setlogmask(LOG_UPTO(LOG_WARNING));
+    }
     
-    int consecutive_failures = 0;
-    const int max_failures = 10;
+    // Same decision path as the service, but the LEDs only count writes and never sleep
+    led_controller_t led_controller;
+    led_controller.start_mock();
+    led_state_manager_t state_manager(led_controller, config);
+    state_manager.set_state(0);
+    
+    bandwidth_monitor_t bandwidth_monitor(trace.get_interface(), trace.get_capacity_mbps());
+    state_manager.set_capacity_mbps(bandwidth_monitor.get_capacity_mbps(),
+                                    bandwidth_monitor.get_direction_capacity_mbps());
+    
+    printf("# %s: %s, %u Mbps, %zu samples over %.1f s\n", path.c_str(), trace.get_interface().c_str(),
+           trace.get_capacity_mbps(), records.size(), records.back().time_us / 1e6);
+    
+    // Sample times are rebuilt from the trace, so hold times and decay
+    // behave exactly as they did while recording
+    auto base = std::chrono::steady_clock::now();
+    bandwidth_monitor.initialize_from(counter_trace_t::to_stats(records[0], base));
+    uint64_t writes_before = led_controller.get_write_count();
+    size_t valid = 0, resynced = 0, transitions = 0;
+    
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 1; i < records.size(); ++i) {
+        bandwidth_info_t info = bandwidth_monitor.compute_usage(counter_trace_t::to_stats(records[i], base));
+        if (!info.valid) {
+            resynced += info.resynced ? 1 : 0;
+            continue;
+        }
+        ++valid;
+        
+        led_state_t previous = state_manager.get_current_state();
+        state_manager.update_leds(info);
+        state_manager.update_alerts(info);
+        
+        led_state_t current = state_manager.get_current_state();
+        if (current != previous) {
+            ++transitions;
+            printf("%10.3f s  %8.1f Mbps (rx %8.1f, tx %8.1f)  %s -> %s\n", records[i].time_us / 1e6,
+                   info.total_mbps, info.rx_mbps, info.tx_mbps,
+                   state_manager.get_state_name(previous), state_manager.get_state_name(current));
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    size_t samples = records.size() - 1;
+    printf("# %zu samples (%zu valid, %zu resynced, %zu invalid), %zu transitions, %llu LED writes\n",
+           samples, valid, resynced, samples - valid - resynced, transitions,
+           (unsigned long long)(led_controller.get_write_count() - writes_before));
+    printf("# %.3f ms, %.0f samples/s, %.0f ns/sample\n", elapsed * 1e3,
+           elapsed > 0.0 ? samples / elapsed : 0.0, elapsed * 1e9 / samples);
+    return true;
+}
+
+bool run_decode_mode(const std::string& path) {
+    i2c_capture_t capture;
+    if (!capture.load(path)) {
+        fprintf(stderr, "Error: cannot read I2C capture %s\n", path.c_str());
+        return false;
+    }
     
+    const std::vector<i2c_capture_record_t>& records = capture.get_records();
+    printf("# %s: %zu transfers over %.1f s%s\n", path.c_str(), records.size(),
+           records.empty() ? 0.0 : records.back().time_us / 1e6, capture.is_mock() ? " on the mock bus" : "");
+    
+    // Latency per kind of transfer, for the bus model
+    struct latency_t {
+        const char* name;
+        size_t count;
+        size_t failed;
+        double total_ms;
+        double max_ms;
+    };
+    latency_t latencies[] = {
+        {"write", 0, 0, 0.0, 0.0},
+        {"block read", 0, 0, 0.0, 0.0},
+        {"byte read", 0, 0, 0.0, 0.0}
+    };
+    
+    char text[128];
+    for (const i2c_capture_record_t& record : records) {
+        double latency_ms = record.latency_ns / 1e6;
+        led_controller_t::describe_transfer(record, capture.is_mock(), text, sizeof(text));
+        printf("%12.6f s  %-64s %7.3f ms\n", record.time_us / 1e6, text, latency_ms);
+        
+        latency_t& latency = latencies[(size_t)record.type % 3];
+        latency.count++;
+        latency.failed += record.rc < 0 ? 1 : 0;
+        latency.total_ms += latency_ms;
+        latency.max_ms = std::max(latency.max_ms, latency_ms);
+    }
+    
+    for (const latency_t& latency : latencies) {
+        if (latency.count) {
+            printf("# %-10s %6zu transfers, %zu failed, %.3f ms mean, %.3f ms max\n", latency.name, latency.count,
+                   latency.failed, latency.total_ms / latency.count, latency.max_ms);
+        }
+    }
+    return true;
+}
+
+bool run_generate_mode(const std::string& profile_text, const ledctl_config_t& config) {
+    std::vector<traffic_step_t> profile;
+    if (!counter_generator_t::parse_profile(profile_text, profile)) {
+        fprintf(stderr, "Error: invalid traffic profile %s\n", profile_text.c_str());
+        return false;
+    }
+    
+    // Link speed of the fake interface, capacity_mbps counts both directions
+    uint32_t speed_mbps = config.capacity_mbps ? config.capacity_mbps / 2 : DEFAULT_CAPACITY_MBPS / 2;
+    
+    counter_generator_t generator;
+    if (!generator.create(get_sys_root(), config.interface, speed_mbps, profile)) {
+        fprintf(stderr, "Error: cannot create the fake tree below %s\n", get_sys_root().c_str());
+        return false;
+    }
+    
+    printf("Generating traffic on %s (%u Mbps) below %s (Ctrl+C to stop)\n", config.interface.c_str(), speed_mbps,
+           get_sys_root().c_str());
+    fflush(stdout);
+    
+    size_t step = SIZE_MAX;
+    auto last = std::chrono::steady_clock::now();
     while (g_running) {
-        auto bandwidth_info = bandwidth_monitor.get_bandwidth_usage();
+        std::this_thread::sleep_for(std::chrono::milliseconds(GENERATOR_PERIOD_MS));
         
-        if (bandwidth_info.valid) {
-            consecutive_failures = 0; // Reset failure counter
-            
-            syslog(LOG_DEBUG, "Bandwidth: RX=%.1f Mbps, TX=%.1f Mbps, Total=%.1f Mbps (%.1f%%)",
-                   bandwidth_info.rx_mbps, bandwidth_info.tx_mbps,
-                   bandwidth_info.total_mbps, bandwidth_info.usage_percentage);
-            
-            if (!state_manager.update_leds(bandwidth_info)) {
-                syslog(LOG_WARNING, "Failed to update LEDs");
+        auto now = std::chrono::steady_clock::now();
+        if (!generator.advance(std::chrono::duration<double>(now - last).count())) {
+            return false;
+        }
+        last = now;
+        
+        if (generator.get_step() != step) {
+            step = generator.get_step();
+            printf("step %zu: rx %.1f Mbps, tx %.1f Mbps for %.1f s\n", step,
+                   generator.get_current().rx_mbps, generator.get_current().tx_mbps, generator.get_current().seconds);
+            fflush(stdout);
+        }
+    }
+    return true;
+}
+
+bool run_normal_mode(bandwidth_monitor_t& bandwidth_monitor, disk_monitor_t* disk_monitor,
+                     led_state_manager_t& state_manager, adaptive_scheduler_t& scheduler,
+                     link_watcher_t* link_watcher, history_archive_t* history,
+                     traffic_totals_t* totals, const std::string& record_path, const ledctl_config_t& config,
+                     startup_timer_t& startup) {
+    os_syslog(LOG_INFO, "Starting normal monitoring mode");
+    
+    os_syslog(LOG_INFO, "Monitoring interface: %s (capacity: %u Mbps%s)",
+              bandwidth_monitor.get_interface().c_str(),
+              bandwidth_monitor.get_capacity_mbps(),
+              bandwidth_monitor.is_auto_capacity() ? ", auto" : "");
+    state_manager.set_capacity_mbps(bandwidth_monitor.get_capacity_mbps(),
+                                    bandwidth_monitor.get_direction_capacity_mbps());
+    
+    counter_trace_t trace;
+    if (!record_path.empty()) {
+        if (!trace.create(record_path, bandwidth_monitor.get_interface(), bandwidth_monitor.get_capacity_mbps())) {
+            fprintf(stderr, "Error: cannot create counter trace %s\n", record_path.c_str());
+            return false;
+        }
+        bandwidth_monitor.set_trace(&trace);
+    }
+    
+    if (disk_monitor && !disk_monitor->initialize()) {
+        os_syslog(LOG_WARNING, "Failed to initialize disk monitor, disk LEDs disabled");
+        disk_monitor = nullptr;
+    }
+    
+    // Alerts need the packet, error and drop counters
+    if (config.alert_drop_rate || config.alert_error_rate) {
+        bandwidth_monitor.enable_extended_counters();
+    }
+    
+    // All sources are sampled from this loop, each on its own period
+    metric_scheduler_t metrics;
+    nic_bytes_source_t network_source(bandwidth_monitor);
+    metrics.add_source(&network_source, config.network_period_ms);
+    
+    std::unique_ptr<nic_packets_source_t> packets_source;
+    if (config.packets_source) {
+        packets_source.reset(new nic_packets_source_t(bandwidth_monitor));
+        metrics.add_source(packets_source.get(), config.network_period_ms);
+    }
+    
+    std::unique_ptr<disk_source_t> disk_source;
+    if (disk_monitor) {
+        disk_source.reset(new disk_source_t(*disk_monitor, config.disk_capacity_mbs));
+        metrics.add_source(disk_source.get(), config.disks_period_ms);
+    }
+    
+    std::unique_ptr<psi_source_t> psi_source;
+    if (config.psi_resource != "off") {
+        psi_source.reset(new psi_source_t(config.psi_resource));
+        metrics.add_source(psi_source.get(), config.psi_period_ms);
+    }
+    
+    std::unique_ptr<thermal_source_t> thermal_source;
+    if (config.thermal_zone != "off") {
+        thermal_source.reset(new thermal_source_t(config.thermal_zone));
+        metrics.add_source(thermal_source.get(), config.thermal_period_ms);
+    }
+    
+    // The reference sample was taken before the initial LED frame, which
+    // normally keeps the bus busy for longer than this
+    auto first_sample = bandwidth_monitor.get_reference_time() + std::chrono::milliseconds(FIRST_SAMPLE_MIN_MS);
+    std::this_thread::sleep_until(first_sample);
+    
+    if (link_watcher) {
+        state_manager.set_link_state(link_watcher->is_link_up());
+    }
+    
+    monitor_loop_t loop(metrics, network_source, disk_source.get(), state_manager, scheduler, history, totals);
+    
+    bool first = true;
+    while (g_running) {
+        if (!loop.tick(std::chrono::steady_clock::now())) {
+            return false;
+        }
+        if (first) {
+            first = false;
+            startup.mark("first measurement");
+            startup.log("the first measurement");
+        }
+        
+        // Checked before every wait: a signal that arrives while a tick runs
+        // does not interrupt the wait that follows it
+        if (g_toggle_maintenance) {
+            g_toggle_maintenance = 0;
+            state_manager.set_maintenance(!state_manager.is_maintenance());
+        }
+        if (g_notify_pending) {
+            g_notify_pending = 0;
+            state_manager.load_notifications(config.notifications_path);
+        }
+        
+        // Wait for the next measurement (adaptive interval)
+        adaptive_scheduler_t::wake_reason_t reason = scheduler.wait();
+        if (link_watcher && !config.link_events && link_watcher->process_events()) {
+            // Without link_events only the sampling picks up link changes
+            reason = adaptive_scheduler_t::wake_reason_t::link_event;
+        }
+        if (reason == adaptive_scheduler_t::wake_reason_t::link_event) {
+            if (link_watcher) {
+                state_manager.set_link_state(link_watcher->is_link_up());
             }
-        } else {
-            consecutive_failures++;
-            syslog(LOG_WARNING, "Invalid bandwidth measurement (failure %d/%d)",
-                   consecutive_failures, max_failures);
-            
-            if (consecutive_failures >= max_failures) {
-                syslog(LOG_ERR, "Too many consecutive bandwidth measurement failures, exiting");
-                return false;
+            if (bandwidth_monitor.update_link_capacity()) {
+                // Link renegotiated, e.g. 2.5G -> 1G after a cable swap
+                state_manager.set_capacity_mbps(bandwidth_monitor.get_capacity_mbps(),
+                                                bandwidth_monitor.get_direction_capacity_mbps());
             }
         }
-        
-        // Wait 1 second before next measurement
-        std::this_thread::sleep_for(std::chrono::seconds(1));
     }
     
-    syslog(LOG_INFO, "Normal monitoring mode completed");
+    os_syslog(LOG_INFO, "Normal monitoring mode completed");
     return true;
 }
 
 int main(int argc, char* argv[]) {
-    // Check if another instance is already running
-    if (is_already_running()) {
-        std::cerr << "Error: Another instance of ugreen_leds_ethutild is already running." << std::endl;
-        std::cerr << "Only one instance is allowed to prevent conflicts." << std::endl;
-        std::cerr << "Please stop the existing instance before starting a new one." << std::endl;
-        return 1;
-    }
-    
+    startup_timer_t startup;
     bool test_mode = false;
+    bool history_mode = false;
+    bool totals_mode = false;
+    std::string history_resolution = "1m";
+    std::string record_path;
+    std::string replay_path;
+    std::string capture_path;
+    std::string decode_path;
+    std::string root;
+    bool generate_mode = false;
+    std::string generate_profile = DEFAULT_TRAFFIC_PROFILE;
     
     // Parse command line arguments
     static struct option long_options[] = {
         {"test", no_argument, 0, 't'},
         {"help", no_argument, 0, 'h'},
         {"version", no_argument, 0, 'v'},
+        {"history", optional_argument, 0, 'H'},
+        {"totals", no_argument, 0, 'T'},
+        {"record", required_argument, 0, 'R'},
+        {"replay", required_argument, 0, 'P'},
+        {"capture", required_argument, 0, 'C'},
+        {"decode", required_argument, 0, 'D'},
+        {"root", required_argument, 0, 'r'},
+        {"generate", optional_argument, 0, 'g'},
         {0, 0, 0, 0}
     };
     
@@ -281,6 +639,36 @@ int main(int argc, char* argv[]) {
             case 't':
                 test_mode = true;
                 break;
+            case 'H':
+                history_mode = true;
+                if (optarg) {
+                    history_resolution = optarg;
+                }
+                break;
+            case 'T':
+                totals_mode = true;
+                break;
+            case 'R':
+                record_path = optarg;
+                break;
+            case 'P':
+                replay_path = optarg;
+                break;
+            case 'C':
+                capture_path = optarg;
+                break;
+            case 'D':
+                decode_path = optarg;
+                break;
+            case 'r':
+                root = optarg;
+                break;
+            case 'g':
+                generate_mode = true;
+                if (optarg) {
+                    generate_profile = optarg;
+                }
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -295,57 +683,183 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (generate_mode && root.empty()) {
+        fputs("Error: --generate needs --root\n", stderr);
+        return 1;
+    }
+    set_sys_root(root);
+    
     // Load configuration
     config_parser_t config_parser;
     ledctl_config_t config;
     
     if (!config_parser.load_config(config)) {
-        std::cerr << "Failed to load configuration" << std::endl;
+        fputs("Failed to load configuration\n", stderr);
+        return 1;
+    }
+    startup.mark("config");
+    
+    // Queries only read files and can run next to the service
+    if (history_mode) {
+        return run_history_query(config.history_path, history_resolution) ? 0 : 1;
+    }
+    if (totals_mode) {
+        return run_totals_query(config.totals_directory, config.interface) ? 0 : 1;
+    }
+    if (!decode_path.empty()) {
+        return run_decode_mode(decode_path) ? 0 : 1;
+    }
+    
+    // A replay never touches the hardware and can run next to the service
+    if (!replay_path.empty()) {
+        setup_logging(config.log_level, true);
+        bool replayed = run_replay_mode(replay_path, config);
+        closelog();
+        return replayed ? 0 : 1;
+    }
+    
+    if (generate_mode) {
+        setup_logging(config.log_level, true);
+        setup_signal_handlers();
+        bool generated = run_generate_mode(generate_profile, config);
+        closelog();
+        return generated ? 0 : 1;
+    }
+    
+    // Check if another instance is already running (an instance below
+    // another root cannot reach the real hardware and may run next to it)
+    if (root.empty() && is_already_running()) {
+        fputs("Error: Another instance of ugreen_leds_ethutild is already running.\n", stderr);
+        fputs("Only one instance is allowed to prevent conflicts.\n", stderr);
+        fputs("Please stop the existing instance before starting a new one.\n", stderr);
         return 1;
     }
+    startup.mark("instance check");
     
     // Setup logging (enable console output for interactive use)
     bool console_mode = isatty(STDERR_FILENO) || test_mode;
     setup_logging(config.log_level, console_mode);
     setup_signal_handlers();
     
-    syslog(LOG_INFO, "LED Control Service starting (interface: %s, capacity: %u Mbps, brightness: %u, thresholds: %u/%u/%u%%)",
-           config.interface.c_str(), config.capacity_mbps, config.brightness,
-           config.low_threshold, config.medium_threshold, config.high_threshold);
+    os_syslog(LOG_INFO, "LED Control Service starting (interface: %s, capacity: %s, brightness: %u, thresholds: %u/%u/%u%%)",
+              config.interface.c_str(),
+              config.capacity_mbps ? (std::to_string(config.capacity_mbps) + " Mbps").c_str() : "auto",
+              config.brightness,
+              config.low_threshold, config.medium_threshold, config.high_threshold);
+    
+    // Initialize bandwidth monitor
+    bandwidth_monitor_t bandwidth_monitor(config.interface, config.capacity_mbps);
+    // Netlink talks to the kernel directly and would bypass a fake tree
+    if (config.counters == "netlink" && !get_sys_root().empty()) {
+        os_syslog(LOG_WARNING, "Netlink counters cannot be read below --root, using files");
+    } else {
+        bandwidth_monitor.set_counter_backend(config.counters);
+    }
+    
+    // The interface check takes the reference counter sample, so the first
+    // measurement is due right after the initial LED frame. It shares
+    // nothing with the adapter scan, which runs next to it.
+    bool monitor_ready = false;
+    double interface_ms = 0.0;
+    std::thread interface_check;
+    if (!test_mode) {
+        interface_check = std::thread([&bandwidth_monitor, &monitor_ready, &interface_ms]() {
+            auto begin = std::chrono::steady_clock::now();
+            monitor_ready = bandwidth_monitor.initialize();
+            interface_ms = startup_timer_t::ms_since(begin);
+        });
+    }
     
     // Initialize LED controller
     led_controller_t led_controller;
-    if (led_controller.start() != 0) {
-        syslog(LOG_ERR, "Failed to initialize LED controller");
-        std::cerr << "Error: Failed to initialize LED controller" << std::endl;
-        std::cerr << "Please check that:" << std::endl;
-        std::cerr << "  1. You have root permissions" << std::endl;
-        std::cerr << "  2. The i2c-dev module is loaded" << std::endl;
-        std::cerr << "  3. The hardware is compatible" << std::endl;
+    auto discovery = std::chrono::steady_clock::now();
+    bool controller_ready = led_controller.start(config.led_bus) == 0;
+    startup.add("adapter", startup_timer_t::ms_since(discovery));
+    if (interface_check.joinable()) {
+        interface_check.join();
+        startup.add("interface", interface_ms);
+    }
+    startup.mark("discovery");
+    
+    if (!controller_ready) {
+        os_syslog(LOG_ERR, "Failed to initialize LED controller");
+        fputs("Error: Failed to initialize LED controller\n", stderr);
+        fputs("Please check that:\n", stderr);
+        fputs("  1. You have root permissions\n", stderr);
+        fputs("  2. The i2c-dev module is loaded\n", stderr);
+        fputs("  3. The hardware is compatible\n", stderr);
+        return 1;
+    }
+    if (!test_mode && !monitor_ready) {
+        os_syslog(LOG_ERR, "Failed to initialize bandwidth monitor for interface %s",
+                  bandwidth_monitor.get_interface().c_str());
+        fprintf(stderr, "Error: Failed to initialize bandwidth monitor for interface %s\n",
+                bandwidth_monitor.get_interface().c_str());
+        fputs("Please check that the network interface exists and is active.\n", stderr);
         return 1;
     }
     
+    // From the initial frame on, the mock bus counts from zero on its own clock
+    i2c_capture_t capture;
+    if (!capture_path.empty()) {
+        auto start = led_controller.is_mock() ? std::chrono::steady_clock::time_point() : std::chrono::steady_clock::now();
+        if (!capture.create(capture_path, led_controller.is_mock(), start)) {
+            fprintf(stderr, "Error: cannot create I2C capture %s\n", capture_path.c_str());
+            return 1;
+        }
+        led_controller.set_capture(&capture);
+    }
+    
     // Initialize LED state manager
     led_state_manager_t state_manager(led_controller, config);
     
     // Set initial state (power LED on, utilization LEDs off)
-    state_manager.set_state(led_state_t::UTILIZATION_OFF);
+    state_manager.set_state(0);
+    startup.mark("initial frame");
     
     bool success = false;
     
     if (test_mode) {
+        startup.log("the initial frame");
         success = run_testing_mode(state_manager);
     } else {
-        // Initialize bandwidth monitor
-        bandwidth_monitor_t bandwidth_monitor(config.interface, config.capacity_mbps);
-        success = run_normal_mode(bandwidth_monitor, state_manager);
+        link_watcher_t link_watcher;
+        // Link events are needed both for fast wakeups and for tracking
+        // renegotiation, only link_events lets them cut a wait short
+        bool watch_links = (config.link_events || config.capacity_mbps == 0 || config.alert_link_down) &&
+                           link_watcher.start(config.interface);
+        bool wake_on_links = watch_links && config.link_events;
+        adaptive_scheduler_t scheduler(config, wake_on_links ? &link_watcher : nullptr);
+        
+        os_syslog(LOG_INFO, "Sampling every %u-%u ms (trigger: %u%%, link events: %s)",
+                  config.interval_ms, config.max_interval_ms, config.trigger_percentage,
+                  wake_on_links ? "on" : "off");
+        
+        disk_monitor_t disk_monitor(config.disk_ports);
+        
+        history_archive_t history;
+        bool keep_history = config.history_enabled && history.open(config.history_path, config.history_sync_interval_s);
+        
+        traffic_totals_t totals;
+        bool keep_totals = config.totals_enabled &&
+                           totals.open(traffic_totals_t::get_path(config.totals_directory, config.interface),
+                                       config.interface, config.totals_flush_interval_s);
+        
+        success = run_normal_mode(bandwidth_monitor, config.disks_enabled ? &disk_monitor : nullptr,
+                                  state_manager, scheduler, watch_links ? &link_watcher : nullptr,
+                                  keep_history ? &history : nullptr, keep_totals ? &totals : nullptr, record_path, config,
+                                  startup);
+        
+        if (keep_totals) {
+            totals.flush(true);
+        }
     }
     
     // Turn off all LEDs before exit (including power LED)
-    syslog(LOG_INFO, "Turning off all LEDs before shutdown");
+    os_syslog(LOG_INFO, "Turning off all LEDs before shutdown");
     led_controller.turn_off_all_leds();
     
-    syslog(LOG_INFO, "LED Control Service stopped");
+    os_syslog(LOG_INFO, "LED Control Service stopped");
     closelog();
     
     return success ? 0 : 1;
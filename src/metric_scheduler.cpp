@@ -0,0 +1,48 @@
+#include "metric_scheduler.h"
+#include "os.h"
+#include <syslog.h>
+#include <string>
+
+void metric_scheduler_t::add_source(metric_source_t* source, uint32_t period_ms) {
+    _entries.push_back({source, period_ms, metric_time_t(), false, false});
+    os_syslog(LOG_INFO, "Metric source %s registered (period: %s)", source->get_name(),
+              period_ms ? (std::to_string(period_ms) + " ms").c_str() : "every tick");
+}
+
+size_t metric_scheduler_t::tick(metric_time_t now) {
+    size_t sampled = 0;
+    
+    for (auto& entry : _entries) {
+        entry.sampled = false;
+        if (now < entry.next_due) {
+            continue;
+        }
+        
+        entry.valid = entry.source->sample(now);
+        entry.sampled = true;
+        entry.next_due = now + std::chrono::milliseconds(entry.period_ms);
+        sampled++;
+        
+        os_syslog(LOG_DEBUG, "Metric %s: %.2f%s", entry.source->get_name(), entry.source->value(),
+                  entry.valid ? "" : " (invalid)");
+    }
+    
+    return sampled;
+}
+
+const metric_scheduler_t::entry_t* metric_scheduler_t::find(const metric_source_t* source) const {
+    for (const auto& entry : _entries) {
+        if (entry.source == source) return &entry;
+    }
+    return nullptr;
+}
+
+bool metric_scheduler_t::was_sampled(const metric_source_t* source) const {
+    const entry_t* entry = find(source);
+    return entry && entry->sampled;
+}
+
+bool metric_scheduler_t::is_valid(const metric_source_t* source) const {
+    const entry_t* entry = find(source);
+    return entry && entry->valid;
+}
@@ -0,0 +1,37 @@
+#ifndef __LEDCTL_METRIC_SCHEDULER_H__
+#define __LEDCTL_METRIC_SCHEDULER_H__
+
+#include <vector>
+#include <cstdint>
+
+#include "metric_source.h"
+
+// Runs every registered source from a single loop. Each source has its own
+// period; on every tick the sources that are due are sampled with the same
+// timestamp, so sources sharing a metric_input_t only cause one read.
+class metric_scheduler_t {
+private:
+    struct entry_t {
+        metric_source_t* source;
+        uint32_t period_ms;         // 0 = every tick
+        metric_time_t next_due;
+        bool sampled;               // sampled in the last tick
+        bool valid;                 // result of the last sample
+    };
+    
+    std::vector<entry_t> _entries;
+    
+    const entry_t* find(const metric_source_t* source) const;
+
+public:
+    void add_source(metric_source_t* source, uint32_t period_ms);
+    
+    // Sample all sources that are due, returns how many were sampled
+    size_t tick(metric_time_t now);
+    
+    // Whether the source was sampled in the last tick, and if the sample was valid
+    bool was_sampled(const metric_source_t* source) const;
+    bool is_valid(const metric_source_t* source) const;
+};
+
+#endif
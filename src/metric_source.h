@@ -0,0 +1,47 @@
+#ifndef __LEDCTL_METRIC_SOURCE_H__
+#define __LEDCTL_METRIC_SOURCE_H__
+
+#include <chrono>
+
+typedef std::chrono::steady_clock::time_point metric_time_t;
+
+// Something the daemon samples periodically (NIC bytes, disk throughput, PSI...)
+class metric_source_t {
+public:
+    virtual ~metric_source_t() {}
+    
+    // Short name for logging
+    virtual const char* get_name() const = 0;
+    
+    // Take a new sample, returns false if the sample is not usable
+    virtual bool sample(metric_time_t now) = 0;
+    
+    // Latest value in the source's natural unit (percent, pps, degrees...)
+    virtual double value() const = 0;
+};
+
+// Data shared by several sources (e.g. one /proc/net/dev read feeding both
+// byte and packet rates). Reads are coalesced: the first source sampling in
+// a tick does the read, the others get the cached result.
+class metric_input_t {
+private:
+    metric_time_t _last_refresh;
+    bool _last_result;
+
+protected:
+    virtual bool read() = 0;
+
+public:
+    metric_input_t() : _last_refresh(), _last_result(false) {}
+    virtual ~metric_input_t() {}
+    
+    bool refresh(metric_time_t now) {
+        if (now != _last_refresh) {
+            _last_refresh = now;
+            _last_result = read();
+        }
+        return _last_result;
+    }
+};
+
+#endif
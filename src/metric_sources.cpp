@@ -0,0 +1,73 @@
+#include "metric_sources.h"
+#include "sys_root.h"
+#include <cstdlib>
+#include <cstring>
+
+bool nic_bytes_source_t::sample(metric_time_t now) {
+    _monitor.refresh(now);
+    return _monitor.get_info().valid;
+}
+
+nic_packets_source_t::nic_packets_source_t(bandwidth_monitor_t& monitor)
+    : _monitor(monitor) {
+    _monitor.enable_extended_counters();
+}
+
+bool nic_packets_source_t::sample(metric_time_t now) {
+    _monitor.refresh(now);
+    return _monitor.get_info().valid;
+}
+
+double nic_packets_source_t::value() const {
+    return _monitor.get_info().rx_pps + _monitor.get_info().tx_pps;
+}
+
+bool disk_source_t::sample(metric_time_t now) {
+    if (!_monitor.refresh(now)) {
+        return false;
+    }
+    
+    _value = 0.0;
+    for (const auto& usage : _monitor.get_usage()) {
+        double percentage = (usage.read_mbs + usage.write_mbs) / _capacity_mbs * 100.0;
+        if (percentage > _value) {
+            _value = percentage;
+        }
+    }
+    return true;
+}
+
+psi_source_t::psi_source_t(const std::string& resource)
+    : _file(sys_path("/proc/pressure/" + resource)), _name("psi_" + resource), _value(0.0) {
+}
+
+bool psi_source_t::sample(metric_time_t) {
+    // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+    char buf[256];
+    if (!_file.read(buf, sizeof(buf))) {
+        return false;
+    }
+    
+    const char* avg10 = strstr(buf, "avg10=");
+    if (!avg10) {
+        return false;
+    }
+    
+    _value = strtod(avg10 + 6, nullptr);
+    return true;
+}
+
+thermal_source_t::thermal_source_t(const std::string& zone)
+    : _file(sys_path("/sys/class/thermal/" + zone + "/temp")), _name(zone), _value(0.0) {
+}
+
+bool thermal_source_t::sample(metric_time_t) {
+    // Millidegrees Celsius
+    char buf[32];
+    if (!_file.read(buf, sizeof(buf))) {
+        return false;
+    }
+    
+    _value = strtol(buf, nullptr, 10) / 1000.0;
+    return true;
+}
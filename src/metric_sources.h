@@ -0,0 +1,87 @@
+#ifndef __LEDCTL_METRIC_SOURCES_H__
+#define __LEDCTL_METRIC_SOURCES_H__
+
+#include <string>
+
+#include "metric_source.h"
+#include "bandwidth_monitor.h"
+#include "disk_monitor.h"
+#include "sys_root.h"
+
+// NIC utilization in percent of the link capacity
+class nic_bytes_source_t : public metric_source_t {
+private:
+    bandwidth_monitor_t& _monitor;
+
+public:
+    explicit nic_bytes_source_t(bandwidth_monitor_t& monitor) : _monitor(monitor) {}
+    
+    const char* get_name() const override { return "nic_bytes"; }
+    bool sample(metric_time_t now) override;
+    double value() const override { return _monitor.get_info().usage_percentage; }
+    
+    const bandwidth_info_t& get_info() const { return _monitor.get_info(); }
+};
+
+// NIC packets per second (RX + TX), shares the counter read with nic_bytes_source_t
+class nic_packets_source_t : public metric_source_t {
+private:
+    bandwidth_monitor_t& _monitor;
+
+public:
+    explicit nic_packets_source_t(bandwidth_monitor_t& monitor);
+    
+    const char* get_name() const override { return "nic_packets"; }
+    bool sample(metric_time_t now) override;
+    double value() const override;
+};
+
+// Highest per-bay disk utilization in percent of capacity_mbs
+class disk_source_t : public metric_source_t {
+private:
+    disk_monitor_t& _monitor;
+    uint32_t _capacity_mbs;
+    double _value;
+
+public:
+    disk_source_t(disk_monitor_t& monitor, uint32_t capacity_mbs)
+        : _monitor(monitor), _capacity_mbs(capacity_mbs), _value(0.0) {}
+    
+    const char* get_name() const override { return "disks"; }
+    bool sample(metric_time_t now) override;
+    double value() const override { return _value; }
+    
+    const std::vector<disk_usage_t>& get_usage() const { return _monitor.get_usage(); }
+};
+
+// Pressure stall information: "some avg10" of /proc/pressure/<resource>, in percent
+class psi_source_t : public metric_source_t {
+private:
+    sys_file_t _file;
+    std::string _name;
+    double _value;
+
+public:
+    explicit psi_source_t(const std::string& resource);
+    
+    const char* get_name() const override { return _name.c_str(); }
+    bool sample(metric_time_t now) override;
+    double value() const override { return _value; }
+};
+
+// Temperature of a thermal zone in degrees Celsius
+class thermal_source_t : public metric_source_t {
+private:
+    sys_file_t _file;
+    std::string _name;
+    double _value;
+
+public:
+    explicit thermal_source_t(const std::string& zone);
+    
+    const char* get_name() const override { return _name.c_str(); }
+    bool sample(metric_time_t now) override;
+    double value() const override { return _value; }
+};
+
+#endif
@@ -0,0 +1,114 @@
+#include "monitor_loop.h"
+#include "os.h"
+#include <syslog.h>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+// Failed measurements in a row before the service gives up
+#define MAX_CONSECUTIVE_FAILURES 10
+
+monitor_loop_t::monitor_loop_t(metric_scheduler_t& metrics, nic_bytes_source_t& network_source,
+                               disk_source_t* disk_source, led_state_manager_t& state_manager,
+                               adaptive_scheduler_t& scheduler, history_archive_t* history,
+                               traffic_totals_t* totals)
+    : _metrics(metrics), _network_source(network_source), _disk_source(disk_source),
+      _state_manager(state_manager), _scheduler(scheduler), _history(history), _totals(totals),
+      _consecutive_failures(0), _network_usage(0.0), _disk_usage(0.0), _ticks(0),
+      _window_start(std::chrono::steady_clock::now()), _calls_per_tick(0.0) {
+    os_get_call_counts(_window_calls);
+}
+
+bool monitor_loop_t::tick(metric_time_t now) {
+    count_calls(now);
+    _metrics.tick(now);
+    
+    if (_disk_source && _metrics.was_sampled(_disk_source) && _metrics.is_valid(_disk_source)) {
+        _disk_usage = _disk_source->value();
+        if (!_state_manager.update_disk_leds(_disk_source->get_usage())) {
+            os_syslog(LOG_WARNING, "Failed to update disk LEDs");
+        }
+    }
+    
+    if (_metrics.was_sampled(&_network_source)) {
+        const bandwidth_info_t& bandwidth_info = _network_source.get_info();
+        
+        if (bandwidth_info.valid) {
+            _consecutive_failures = 0; // Reset failure counter
+            _network_usage = bandwidth_info.usage_percentage;
+            
+            os_syslog(LOG_DEBUG, "Bandwidth: RX=%.1f Mbps, TX=%.1f Mbps, Total=%.1f Mbps (%.1f%%)",
+                      bandwidth_info.rx_mbps, bandwidth_info.tx_mbps,
+                      bandwidth_info.total_mbps, bandwidth_info.usage_percentage);
+            
+            if (!_state_manager.update_leds(bandwidth_info)) {
+                os_syslog(LOG_WARNING, "Failed to update LEDs");
+            }
+            
+            if (_totals) {
+                _totals->add(bandwidth_info.rx_bytes, bandwidth_info.tx_bytes, time(nullptr));
+            }
+            
+            if (_history) {
+                auto wall = std::chrono::system_clock::now().time_since_epoch();
+                _history->add(std::chrono::duration<double>(wall).count(),
+                              bandwidth_info.rx_mbps, bandwidth_info.tx_mbps);
+            }
+            
+            if (!_state_manager.update_alerts(bandwidth_info)) {
+                os_syslog(LOG_WARNING, "Failed to update alert LED");
+            }
+            
+            // Disk activity also keeps the sampling fast
+            _scheduler.update(std::max(_network_usage, _disk_usage));
+        } else if (bandwidth_info.resynced) {
+            // Counters were reset under us, keep the LEDs as they are and take
+            // a fresh sample as soon as possible
+            _scheduler.reset();
+        } else {
+            _consecutive_failures++;
+            _scheduler.reset();
+            os_syslog(LOG_WARNING, "Invalid bandwidth measurement (failure %d/%d)",
+                      _consecutive_failures, MAX_CONSECUTIVE_FAILURES);
+            
+            if (_consecutive_failures >= MAX_CONSECUTIVE_FAILURES) {
+                os_syslog(LOG_ERR, "Too many consecutive bandwidth measurement failures, exiting");
+                return false;
+            }
+        }
+    }
+    
+    _state_manager.update_overlays();
+    if (!_state_manager.reconcile(now)) {
+        os_syslog(LOG_WARNING, "Failed to repair LEDs");
+    }
+    return true;
+}
+
+void monitor_loop_t::count_calls(metric_time_t now) {
+    _ticks++;
+    if (now - _window_start < std::chrono::minutes(1)) {
+        return;
+    }
+    
+    os_call_counts_t calls;
+    os_get_call_counts(calls);
+    _calls_per_tick = (double)(calls.total() - _window_calls.total()) / _ticks;
+    
+    // "pread 2.0, poll 1.0, ..." without touching the heap
+    char detail[256];
+    size_t used = 0;
+    detail[0] = '\0';
+    for (size_t i = 0; i < (size_t)os_call_t::count && used < sizeof(detail); ++i) {
+        uint64_t count = calls.calls[i] - _window_calls.calls[i];
+        if (count) {
+            used += snprintf(detail + used, sizeof(detail) - used, "%s%s %.1f", used ? ", " : "",
+                             os_get_call_name((os_call_t)i), (double)count / _ticks);
+        }
+    }
+    os_syslog(LOG_DEBUG, "System calls: %.1f per iteration over %u iterations (%s)", _calls_per_tick, _ticks, detail);
+    
+    _ticks = 0;
+    _window_start = now;
+    _window_calls = calls;
+}
@@ -0,0 +1,49 @@
+#ifndef __LEDCTL_MONITOR_LOOP_H__
+#define __LEDCTL_MONITOR_LOOP_H__
+
+#include "metric_scheduler.h"
+#include "metric_sources.h"
+#include "led_state_manager.h"
+#include "adaptive_scheduler.h"
+#include "history_archive.h"
+#include "traffic_totals.h"
+#include "os.h"
+
+// Body of the monitoring loop: samples the sources that are due and brings
+// the LEDs, history and totals up to date. Waiting and signals stay with the
+// caller, so the service and the benchmarks run the very same code.
+class monitor_loop_t {
+private:
+    metric_scheduler_t& _metrics;
+    nic_bytes_source_t& _network_source;
+    disk_source_t* _disk_source;
+    led_state_manager_t& _state_manager;
+    adaptive_scheduler_t& _scheduler;
+    history_archive_t* _history;
+    traffic_totals_t* _totals;
+    int _consecutive_failures;
+    double _network_usage;
+    double _disk_usage;
+    
+    // System call accounting, logged once a minute
+    uint32_t _ticks;
+    metric_time_t _window_start;
+    os_call_counts_t _window_calls;     // counts at the start of the window
+    double _calls_per_tick;
+    
+    void count_calls(metric_time_t now);
+
+public:
+    monitor_loop_t(metric_scheduler_t& metrics, nic_bytes_source_t& network_source, disk_source_t* disk_source,
+                   led_state_manager_t& state_manager, adaptive_scheduler_t& scheduler,
+                   history_archive_t* history, traffic_totals_t* totals);
+    
+    // One iteration, false after too many consecutive failed measurements.
+    // Does not allocate once every path has been taken.
+    bool tick(metric_time_t now);
+    
+    // System calls per iteration (tick and wait) over the last full minute
+    double get_calls_per_tick() const { return _calls_per_tick; }
+};
+
+#endif
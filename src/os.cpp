@@ -0,0 +1,151 @@
+#include "os.h"
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+
+// Relaxed: the counters are statistics, startup may call from several threads
+static std::atomic<uint64_t> g_calls[(size_t)os_call_t::count];
+
+static const char* const CALL_NAMES[(size_t)os_call_t::count] = {
+    "open", "close", "read", "pread", "write", "pwrite", "ioctl", "poll", "nanosleep",
+    "socket", "bind", "send", "recv", "rename", "fsync", "msync", "flock", "syslog"
+};
+
+static inline void count_call(os_call_t call) {
+    g_calls[(size_t)call].fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t os_call_counts_t::total() const {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < (size_t)os_call_t::count; ++i) {
+        sum += calls[i];
+    }
+    return sum;
+}
+
+void os_get_call_counts(os_call_counts_t& counts) {
+    for (size_t i = 0; i < (size_t)os_call_t::count; ++i) {
+        counts.calls[i] = g_calls[i].load(std::memory_order_relaxed);
+    }
+}
+
+uint64_t os_get_call_total() {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < (size_t)os_call_t::count; ++i) {
+        sum += g_calls[i].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+const char* os_get_call_name(os_call_t call) {
+    return call < os_call_t::count ? CALL_NAMES[(size_t)call] : "unknown";
+}
+
+int os_open(const char* path, int flags, mode_t mode) {
+    count_call(os_call_t::open);
+    return open(path, flags, mode);
+}
+
+int os_close(int fd) {
+    count_call(os_call_t::close);
+    return close(fd);
+}
+
+ssize_t os_read(int fd, void* buf, size_t size) {
+    count_call(os_call_t::read);
+    return read(fd, buf, size);
+}
+
+ssize_t os_pread(int fd, void* buf, size_t size, off_t offset) {
+    count_call(os_call_t::pread);
+    return pread(fd, buf, size, offset);
+}
+
+ssize_t os_write(int fd, const void* buf, size_t size) {
+    count_call(os_call_t::write);
+    return write(fd, buf, size);
+}
+
+ssize_t os_pwrite(int fd, const void* buf, size_t size, off_t offset) {
+    count_call(os_call_t::pwrite);
+    return pwrite(fd, buf, size, offset);
+}
+
+int os_ioctl(int fd, unsigned long request, void* arg) {
+    count_call(os_call_t::ioctl);
+    return ioctl(fd, request, arg);
+}
+
+int os_ioctl(int fd, unsigned long request, unsigned long arg) {
+    count_call(os_call_t::ioctl);
+    return ioctl(fd, request, arg);
+}
+
+int os_poll(pollfd* fds, nfds_t count, int timeout_ms) {
+    count_call(os_call_t::poll);
+    return poll(fds, count, timeout_ms);
+}
+
+int os_sleep_us(uint32_t usec) {
+    count_call(os_call_t::nanosleep);
+    timespec duration = { (time_t)(usec / 1000000), (long)(usec % 1000000) * 1000 };
+    return nanosleep(&duration, nullptr);
+}
+
+int os_socket(int domain, int type, int protocol) {
+    count_call(os_call_t::socket);
+    return socket(domain, type, protocol);
+}
+
+int os_bind(int fd, const sockaddr* addr, socklen_t size) {
+    count_call(os_call_t::bind);
+    return bind(fd, addr, size);
+}
+
+ssize_t os_send(int fd, const void* buf, size_t size, int flags) {
+    count_call(os_call_t::send);
+    return send(fd, buf, size, flags);
+}
+
+ssize_t os_recv(int fd, void* buf, size_t size, int flags) {
+    count_call(os_call_t::recv);
+    return recv(fd, buf, size, flags);
+}
+
+int os_rename(const char* from, const char* to) {
+    count_call(os_call_t::rename);
+    return rename(from, to);
+}
+
+int os_fsync(int fd) {
+    count_call(os_call_t::fsync);
+    return fsync(fd);
+}
+
+int os_msync(void* addr, size_t size, int flags) {
+    count_call(os_call_t::msync);
+    return msync(addr, size, flags);
+}
+
+int os_flock(int fd, int operation) {
+    count_call(os_call_t::flock);
+    return flock(fd, operation);
+}
+
+void os_syslog(int priority, const char* format, ...) {
+    // setlogmask(0) only reads the mask, a masked message costs nothing
+    if (setlogmask(0) & LOG_MASK(LOG_PRI(priority))) {
+        count_call(os_call_t::syslog);
+    }
+    va_list args;
+    va_start(args, format);
+    vsyslog(priority, format, args);
+    va_end(args);
+}
@@ -0,0 +1,57 @@
+#ifndef __LEDCTL_OS_H__
+#define __LEDCTL_OS_H__
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <cstdint>
+#include <cstddef>
+
+// Thin wrappers around the system calls the service makes while it runs,
+// each one counted so that the cost of a loop iteration can be measured and
+// held to a budget (make bench). One-off setup calls (mmap, fstat, opendir,
+// ...) are not routed through here. Log messages are, as one syslog call for
+// each message that passes the log mask (the send to the log socket).
+enum class os_call_t {
+    open, close, read, pread, write, pwrite, ioctl, poll, nanosleep,
+    socket, bind, send, recv, rename, fsync, msync, flock, syslog,
+    count
+};
+
+// Receive buffer for rtnetlink messages, big enough for an RTM_NEWLINK of a
+// NIC with many queues and VFs
+#define NETLINK_BUFFER_SIZE 32768
+
+struct os_call_counts_t {
+    uint64_t calls[(size_t)os_call_t::count];
+    
+    uint64_t get(os_call_t call) const { return calls[(size_t)call]; }
+    uint64_t total() const;
+};
+
+// Calls made since the process started
+void os_get_call_counts(os_call_counts_t& counts);
+uint64_t os_get_call_total();
+const char* os_get_call_name(os_call_t call);
+
+int os_open(const char* path, int flags, mode_t mode = 0);
+int os_close(int fd);
+ssize_t os_read(int fd, void* buf, size_t size);
+ssize_t os_pread(int fd, void* buf, size_t size, off_t offset);
+ssize_t os_write(int fd, const void* buf, size_t size);
+ssize_t os_pwrite(int fd, const void* buf, size_t size, off_t offset);
+int os_ioctl(int fd, unsigned long request, void* arg);
+int os_ioctl(int fd, unsigned long request, unsigned long arg);
+int os_poll(pollfd* fds, nfds_t count, int timeout_ms);
+int os_sleep_us(uint32_t usec);
+int os_socket(int domain, int type, int protocol);
+int os_bind(int fd, const sockaddr* addr, socklen_t size);
+ssize_t os_send(int fd, const void* buf, size_t size, int flags);
+ssize_t os_recv(int fd, void* buf, size_t size, int flags);
+int os_rename(const char* from, const char* to);
+int os_fsync(int fd);
+int os_msync(void* addr, size_t size, int flags);
+int os_flock(int fd, int operation);
+void os_syslog(int priority, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
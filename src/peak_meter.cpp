@@ -0,0 +1,29 @@
+#include "peak_meter.h"
+
+peak_meter_t::peak_meter_t()
+    : _hold(std::chrono::milliseconds(1000)), _decay_per_second(0.0), _peak(0.0) {
+}
+
+void peak_meter_t::configure(uint32_t hold_ms, double decay_per_second) {
+    _hold = std::chrono::milliseconds(hold_ms);
+    _decay_per_second = decay_per_second;
+}
+
+double peak_meter_t::update(double sample, std::chrono::steady_clock::time_point now) {
+    double display = _peak;
+    
+    auto held = now - _peak_time;
+    if (held > _hold) {
+        double decaying = std::chrono::duration<double>(held - _hold).count();
+        display = _peak - _decay_per_second * decaying;
+    }
+    
+    // A new peak restarts the hold
+    if (sample >= display) {
+        _peak = sample;
+        _peak_time = now;
+        return sample;
+    }
+    
+    return display;
+}
@@ -0,0 +1,27 @@
+#ifndef __LEDCTL_PEAK_METER_H__
+#define __LEDCTL_PEAK_METER_H__
+
+#include <chrono>
+#include <cstdint>
+
+// VU meter style ballistics: the output jumps to every new peak, stays there
+// for the hold time and then falls at a fixed rate until it meets the input.
+class peak_meter_t {
+private:
+    std::chrono::steady_clock::duration _hold;
+    double _decay_per_second;       // in the unit of the samples
+    double _peak;
+    std::chrono::steady_clock::time_point _peak_time;
+
+public:
+    peak_meter_t();
+    
+    void configure(uint32_t hold_ms, double decay_per_second);
+    
+    // Feed a sample, returns the value to display
+    double update(double sample, std::chrono::steady_clock::time_point now);
+    
+    void reset() { _peak = 0.0; }
+};
+
+#endif
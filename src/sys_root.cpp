@@ -0,0 +1,134 @@
+#include "sys_root.h"
+#include "os.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+static std::string g_sys_root;
+
+void set_sys_root(const std::string& root) {
+    g_sys_root = root;
+    // "/tmp/root/" + "/sys/..." would still work, but keeps log messages tidy
+    while (g_sys_root.size() > 1 && g_sys_root.back() == '/') {
+        g_sys_root.pop_back();
+    }
+    if (g_sys_root == "/") {
+        g_sys_root.clear();
+    }
+}
+
+const std::string& get_sys_root() {
+    return g_sys_root;
+}
+
+std::string sys_path(const std::string& path) {
+    return g_sys_root + path;
+}
+
+bool read_small_file(const std::string& path, char* buf, size_t size) {
+    int fd = os_open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    
+    ssize_t len = os_read(fd, buf, size - 1);
+    os_close(fd);
+    if (len <= 0) {
+        return false;
+    }
+    
+    buf[len] = '\0';
+    return true;
+}
+
+bool read_uint64_file(const std::string& path, uint64_t& value) {
+    char buf[32];
+    if (!read_small_file(path, buf, sizeof(buf))) {
+        return false;
+    }
+    
+    return std::from_chars(buf, buf + strlen(buf), value).ec == std::errc();
+}
+
+bool make_directories(const std::string& path, mode_t mode) {
+    // Every prefix ending before a slash, then the whole path
+    for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+        std::string directory = path.substr(0, slash);
+        if (mkdir(directory.c_str(), mode) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (slash == std::string::npos) {
+            return true;
+        }
+    }
+}
+
+sys_file_t::sys_file_t(const std::string& path) : _path(path), _fd(-1), _open_count(0) {
+}
+
+sys_file_t::~sys_file_t() {
+    if (_fd >= 0) {
+        os_close(_fd);
+    }
+}
+
+void sys_file_t::set_path(const std::string& path) {
+    if (_fd >= 0) {
+        os_close(_fd);
+        _fd = -1;
+    }
+    _path = path;
+}
+
+bool sys_file_t::read(char* buf, size_t size) {
+    while (true) {
+        bool fresh = _fd < 0;
+        if (fresh) {
+            _fd = os_open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (_fd < 0) {
+                return false;
+            }
+            ++_open_count;
+        }
+        
+        ssize_t len = os_pread(_fd, buf, size - 1, 0);
+        if (len > 0) {
+            buf[len] = '\0';
+            return true;
+        }
+        
+        // A stale descriptor gets one more try with the path, a fresh one does not
+        os_close(_fd);
+        _fd = -1;
+        if (fresh) {
+            return false;
+        }
+    }
+}
+
+bool sys_file_t::read(std::vector<char>& buffer) {
+    while (true) {
+        if (!read(buffer.data(), buffer.size())) {
+            return false;
+        }
+        
+        // seq_file and sysfs fill the whole buffer unless the end was reached,
+        // so a short read has everything; otherwise read again with more room
+        size_t len = strlen(buffer.data());
+        if (len + 1 < buffer.size()) {
+            return true;
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+bool sys_file_t::read_uint64(uint64_t& value) {
+    char buf[32];
+    if (!read(buf, sizeof(buf))) {
+        return false;
+    }
+    
+    return std::from_chars(buf, buf + strlen(buf), value).ec == std::errc();
+}
@@ -0,0 +1,63 @@
+#ifndef __LEDCTL_SYS_ROOT_H__
+#define __LEDCTL_SYS_ROOT_H__
+
+#include <sys/types.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Directory standing in for / whenever /sys, /proc or /dev is read, so the
+// service can run unprivileged against a fake tree (--root). Empty for the
+// real root.
+void set_sys_root(const std::string& root);
+const std::string& get_sys_root();
+
+// An absolute system path below the root
+std::string sys_path(const std::string& path);
+
+// Read a small text file (sysfs attribute, procfs entry) into buf, zero
+// terminated, without touching the heap. Returns false on error.
+bool read_small_file(const std::string& path, char* buf, size_t size);
+
+// Read a file holding a single unsigned number
+bool read_uint64_file(const std::string& path, uint64_t& value);
+
+// Create a directory and any missing parents (mkdir -p). Returns false on
+// error with errno set.
+bool make_directories(const std::string& path, mode_t mode = 0755);
+
+// A sysfs attribute or procfs entry that is read over and over: the
+// descriptor stays open and every read is a single pread from offset 0,
+// which makes the kernel generate the contents afresh. When the file goes
+// away (interface removed) reads fail, the descriptor is dropped and the
+// next read opens the path again; get_open_count() tells the caller.
+class sys_file_t {
+private:
+    std::string _path;
+    int _fd;
+    uint32_t _open_count;
+
+public:
+    explicit sys_file_t(const std::string& path = "");
+    ~sys_file_t();
+    sys_file_t(const sys_file_t&) = delete;
+    sys_file_t& operator=(const sys_file_t&) = delete;
+    
+    void set_path(const std::string& path);
+    const std::string& get_path() const { return _path; }
+    
+    // Whole contents into buf, zero terminated
+    bool read(char* buf, size_t size);
+    
+    // Whole contents into buffer, zero terminated, growing it if needed
+    bool read(std::vector<char>& buffer);
+    
+    // Contents as a single unsigned number
+    bool read_uint64(uint64_t& value);
+    
+    // Successful opens so far, goes up when a vanished file came back
+    uint32_t get_open_count() const { return _open_count; }
+};
+
+#endif
@@ -0,0 +1,159 @@
+#include "traffic_totals.h"
+#include "os.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <cerrno>
+#include <cstring>
+
+#define TOTALS_MAGIC "LEDTOTL"
+#define TOTALS_VERSION 1
+
+traffic_totals_t::traffic_totals_t() : _flush_interval_s(300), _dirty(false) {
+}
+
+std::string traffic_totals_t::get_path(const std::string& directory, const std::string& interface) {
+    return directory + "/totals." + interface;
+}
+
+bool traffic_totals_t::open(const std::string& path, const std::string& interface, uint32_t flush_interval_s) {
+    _path = path;
+    _tmp_path = path + ".tmp";
+    size_t slash = path.rfind('/');
+    _directory = slash == std::string::npos ? "." : (slash ? path.substr(0, slash) : "/");
+    _interface = interface;
+    _flush_interval_s = flush_interval_s;
+    _last_flush = std::chrono::steady_clock::now();
+    _days.clear();
+    _months.clear();
+    _days.reserve(MAX_DAYS);
+    _months.reserve(MAX_MONTHS);
+    
+    int fd = os_open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            os_syslog(LOG_INFO, "No traffic totals in %s yet, starting from zero", path.c_str());
+            return true;
+        }
+        os_syslog(LOG_ERR, "Failed to open traffic totals %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    header_t header;
+    bool valid = os_read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+                 memcmp(header.magic, TOTALS_MAGIC, sizeof(TOTALS_MAGIC)) == 0 &&
+                 header.version == TOTALS_VERSION &&
+                 header.day_count <= MAX_DAYS && header.month_count <= MAX_MONTHS;
+    
+    if (valid) {
+        _days.resize(header.day_count);
+        _months.resize(header.month_count);
+        ssize_t days_size = _days.size() * sizeof(traffic_total_t);
+        ssize_t months_size = _months.size() * sizeof(traffic_total_t);
+        valid = os_read(fd, _days.data(), days_size) == days_size &&
+                os_read(fd, _months.data(), months_size) == months_size;
+    }
+    os_close(fd);
+    
+    if (!valid) {
+        // Cannot happen through a crash thanks to the rename, only through outside damage
+        os_syslog(LOG_WARNING, "Traffic totals %s are damaged, starting from zero", path.c_str());
+        _days.clear();
+        _months.clear();
+        return true;
+    }
+    
+    header.interface[sizeof(header.interface) - 1] = '\0';
+    if (interface != header.interface) {
+        os_syslog(LOG_WARNING, "Traffic totals %s belong to %s, not %s", path.c_str(), header.interface, interface.c_str());
+    }
+    
+    os_syslog(LOG_DEBUG, "Loaded %zu days and %zu months of traffic totals", _days.size(), _months.size());
+    return true;
+}
+
+void traffic_totals_t::add_to(std::vector<traffic_total_t>& totals, size_t max_count, uint32_t period,
+                              uint64_t rx_bytes, uint64_t tx_bytes) {
+    if (totals.empty() || totals.back().period != period) {
+        if (totals.size() >= max_count) {
+            totals.erase(totals.begin());
+        }
+        totals.push_back(traffic_total_t{period, 0, 0, 0});
+    }
+    totals.back().rx_bytes += rx_bytes;
+    totals.back().tx_bytes += tx_bytes;
+}
+
+void traffic_totals_t::add(uint64_t rx_bytes, uint64_t tx_bytes, time_t now) {
+    if (rx_bytes == 0 && tx_bytes == 0) {
+        return;
+    }
+    
+    struct tm tm;
+    localtime_r(&now, &tm);
+    uint32_t month = (uint32_t)(tm.tm_year + 1900) * 100 + (uint32_t)(tm.tm_mon + 1);
+    uint32_t day = month * 100 + (uint32_t)tm.tm_mday;
+    
+    add_to(_days, MAX_DAYS, day, rx_bytes, tx_bytes);
+    add_to(_months, MAX_MONTHS, month, rx_bytes, tx_bytes);
+    _dirty = true;
+    
+    flush();
+}
+
+bool traffic_totals_t::flush(bool force) {
+    if (!_dirty || _path.empty()) {
+        return true;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    if (!force && now - _last_flush < std::chrono::seconds(_flush_interval_s)) {
+        return true;
+    }
+    _last_flush = now;
+    
+    header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TOTALS_MAGIC, sizeof(TOTALS_MAGIC));
+    header.version = TOTALS_VERSION;
+    header.day_count = (uint16_t)_days.size();
+    header.month_count = (uint16_t)_months.size();
+    strncpy(header.interface, _interface.c_str(), sizeof(header.interface) - 1);
+    
+    // Write a new file next to the old one, sync it, then swap it in
+    int fd = os_open(_tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 && errno == ENOENT) {
+        // The directory normally comes from systemd's StateDirectory=
+        mkdir(_directory.c_str(), 0755);
+        fd = os_open(_tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (fd < 0) {
+        os_syslog(LOG_ERR, "Failed to create %s: %s", _tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    
+    ssize_t days_size = _days.size() * sizeof(traffic_total_t);
+    ssize_t months_size = _months.size() * sizeof(traffic_total_t);
+    bool written = os_write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+                   os_write(fd, _days.data(), days_size) == days_size &&
+                   os_write(fd, _months.data(), months_size) == months_size &&
+                   os_fsync(fd) == 0;
+    os_close(fd);
+    
+    if (!written || os_rename(_tmp_path.c_str(), _path.c_str()) != 0) {
+        os_syslog(LOG_ERR, "Failed to write traffic totals %s: %s", _path.c_str(), strerror(errno));
+        unlink(_tmp_path.c_str());
+        return false;
+    }
+    
+    // Make the rename itself durable
+    int dir_fd = os_open(_directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+        os_fsync(dir_fd);
+        os_close(dir_fd);
+    }
+    
+    _dirty = false;
+    return true;
+}
@@ -0,0 +1,69 @@
+#ifndef __LEDCTL_TRAFFIC_TOTALS_H__
+#define __LEDCTL_TRAFFIC_TOTALS_H__
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+// Traffic of one day (period = YYYYMMDD) or month (period = YYYYMM)
+struct traffic_total_t {
+    uint32_t period;
+    uint32_t reserved;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+};
+
+// vnstat-style cumulative totals of one interface, kept in memory and
+// written to a small binary file with write-then-rename, so the file is
+// always either the previous or the new version and a crash loses at most
+// one flush interval.
+class traffic_totals_t {
+public:
+    static const size_t MAX_DAYS = 62;
+    static const size_t MAX_MONTHS = 24;
+
+private:
+    struct header_t {
+        char magic[8];
+        uint32_t version;
+        uint16_t day_count;
+        uint16_t month_count;
+        char interface[16];
+    };
+    
+    std::string _path;
+    std::string _tmp_path;                  // the next version is written here first
+    std::string _directory;
+    std::string _interface;
+    std::vector<traffic_total_t> _days;     // oldest first
+    std::vector<traffic_total_t> _months;
+    uint32_t _flush_interval_s;
+    bool _dirty;
+    std::chrono::steady_clock::time_point _last_flush;
+    
+    static void add_to(std::vector<traffic_total_t>& totals, size_t max_count, uint32_t period,
+                       uint64_t rx_bytes, uint64_t tx_bytes);
+
+public:
+    traffic_totals_t();
+    
+    // Load the totals of an interface from path (missing file = start from zero)
+    bool open(const std::string& path, const std::string& interface, uint32_t flush_interval_s);
+    
+    // Account bytes transferred up to now (local time decides the day)
+    void add(uint64_t rx_bytes, uint64_t tx_bytes, time_t now);
+    
+    // Write the file if there is something new and the interval has passed (or always with force)
+    bool flush(bool force = false);
+    
+    const std::vector<traffic_total_t>& get_days() const { return _days; }
+    const std::vector<traffic_total_t>& get_months() const { return _months; }
+    const std::string& get_interface() const { return _interface; }
+    
+    // File name of the totals of an interface in a directory
+    static std::string get_path(const std::string& directory, const std::string& interface);
+};
+
+#endif